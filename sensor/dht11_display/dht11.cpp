@@ -1,28 +1,133 @@
 #include "dht11.h"
+#include "dht11.pio.h"
+#include <hardware/irq.h>
+#include <hardware/sync.h>
+#include <hardware/timer.h>
 
-dht11::dht11(uint8_t data_pin) 
+dht11* dht11::instance_ = nullptr;
+
+dht11::dht11(uint8_t data_pin, PIO pio) 
     : data_pin_(data_pin)
+    , pio_(pio)
 { 
 }
 
-dht11::~dht11() {}
+dht11::~dht11()
+{
+    if (instance_ == this)
+    {
+#if !DHT11_PIO
+        gpio_set_irq_enabled(data_pin_, GPIO_IRQ_EDGE_FALL, false);
+        gpio_remove_raw_irq_handler(data_pin_, gpio_irq_handler);
+#endif
+        hardware_alarm_cancel(alarm_);
+        hardware_alarm_set_callback(alarm_, nullptr);
+        hardware_alarm_unclaim(alarm_);
+        instance_ = nullptr;
+    }
+}
 
 void dht11::init_dev()
 {
     // if gpio > 30, will stop running
     gpio_init(data_pin_);
+    instance_ = this;
+
+#if DHT11_PIO
+    offset_ = pio_add_program(pio_, &dht11_program);
+    sm_ = pio_claim_unused_sm(pio_, true);
+    dht11_program_init(pio_, sm_, offset_, data_pin_);
+#else
+    gpio_add_raw_irq_handler(data_pin_, gpio_irq_handler);
+    irq_set_enabled(IO_IRQ_BANK0, true);
+#endif
+
+    // start pulse and timeouts, the alarm interrupt is enabled on the calling core
+    alarm_ = hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback(alarm_, alarm_callback);
+}
+
+bool dht11::start_read()
+{
+    if (is_reading())
+    {
+        return false;
+    }
+
+    begin_reading();
+    return true;
+}
+
+bool dht11::poll()
+{
+    if (state_ != dht_state::DONE)
+    {
+        return false;
+    }
+
+    state_ = dht_state::IDLE;
+    update_filter();
+    return true;
+}
+
+void dht11::set_read_callback(dht_read_callback_t callback, void* user_data)
+{
+    callback_ = callback;
+    user_data_ = user_data;
+}
+
+void dht11::start_sampling(uint32_t interval_ms)
+{
+    sample_interval_us_ = interval_ms * 1000;
+    if (sampling_)
+    {
+        return;
+    }
+
+    // a reading in flight becomes the first sample
+    poll();
+    sampling_ = true;
+    if (is_reading())
+    {
+        return;
+    }
+
+    // a reading right after the last one fails, wait for the rest of the interval like finish_attempt()
+    uint32_t elapsed = time_us_32() - sample_start_;
+    if (has_read_ && elapsed < sample_interval_us_)
+    {
+        state_ = dht_state::SAMPLE_WAIT;
+        set_alarm(sample_interval_us_ - elapsed);
+    }
+    else
+    {
+        begin_reading();
+    }
+}
+
+void dht11::stop_sampling()
+{
+    // the alarm must not start a reading after the wait is cancelled
+    uint32_t save = save_and_disable_interrupts();
+    sampling_ = false;
+    if (state_ == dht_state::SAMPLE_WAIT)
+    {
+        hardware_alarm_cancel(alarm_);
+        state_ = dht_state::IDLE;
+    }
+    restore_interrupts(save);
 }
 
 double dht11::get_temp()
 {
     read_from_dht();
-    return result_.temp;
+    return result_.get_temp();
 }
 
 double dht11::get_humidity()
 {
     read_from_dht();
-    return result_.humidity;
+    return result_.get_humidity();
 }
 
 dht_reading& dht11::get_temp_and_humidity()
@@ -31,131 +136,310 @@ dht_reading& dht11::get_temp_and_humidity()
     return result_;
 }
 
-double dht11::get_filtered_temp()
+double dht11::get_filtered_temp(uint32_t* age_ms)
 {
-    return 0;
+    return get_filtered_temp_and_humidity(age_ms).get_temp();
 }
 
-double dht11::get_filtered_humidity()
+double dht11::get_filtered_humidity(uint32_t* age_ms)
 {
-    return 0;
+    return get_filtered_temp_and_humidity(age_ms).get_humidity();
 }
 
-dht_reading dht11::get_filtered_temp_and_humidity()
+dht_reading dht11::get_filtered_temp_and_humidity(uint32_t* age_ms)
 {
-    read_from_dht();
-    result_list_.push_back(result_);
-    
-    // only store five elements
-    if (result_list_.size() > 5)
+    update_filter();
+    if (age_ms)
+    {
+        *age_ms = get_age_ms();
+    }
+    return filtered_;
+}
+
+void dht11::read_from_dht()
+{
+    // the sampler reads anyway, the last reading is as new as it gets
+    if (sampling_)
     {
-        result_list_.pop_front();
+        update_filter();
+        return;
     }
 
-    // return the average value
-    dht_reading r;
-    r.temp = 0;
-    r.humidity = 0;
+    // a reading started by start_read() is waited for too
+    start_read();
+    while (!poll())
+    {
+        __wfe();
+    }
+    printf("read times = %d.", attempt_);
+}
+
 
-    for (auto&& data : result_list_)
+void dht11::update_filter()
+{
+    dht_sample sample;
+    bool changed = false;
+    while (ring_.pop(sample))
     {
-        r.temp += data.temp;
-        r.humidity += data.humidity;
+        result_ = sample.reading;
+        newest_us_ = sample.time_us;
+        has_sample_ = true;
+        changed = true;
+        temp_filter_.push(result_.temp_x10);
+        humidity_filter_.push(result_.humidity_x10);
     }
 
-    r.temp = r.temp / result_list_.size();
-    r.humidity = r.humidity / result_list_.size();
-    return r;
+    // once per new reading, the getters only copy it
+    if (changed)
+    {
+        filtered_.temp_x10 = temp_filter_.get();
+        filtered_.humidity_x10 = humidity_filter_.get();
+    }
 }
 
-void dht11::read_from_dht()
+void dht11::set_filter_mode(filter_mode mode)
 {
-    dht_reading result;
-    for (size_t i = 0; i < RETRY_TIMES; i++)
+    temp_filter_.set_mode(mode);
+    humidity_filter_.set_mode(mode);
+    if (has_sample_)
     {
-        if (do_read(result) && is_read_data_reasonable(result))
-        {
-            result_ = result;
-            printf("read times = %d.", i);
-            return;
-        }
-    }   
+        filtered_.temp_x10 = temp_filter_.get();
+        filtered_.humidity_x10 = humidity_filter_.get();
+    }
 }
 
+uint32_t dht11::get_age_ms() const
+{
+    return has_sample_ ? (time_us_32() - newest_us_) / 1000 : DHT_NO_SAMPLE_AGE;
+}
 
-bool dht11::do_read(dht_reading& result)
+void dht11::begin_reading()
 {
-    // DHT data format: 
-    // data[0:4] = 1byte humidity int part | 1byte humidity fraction part | 1byte temp int part | 1byte temp fraction part | check sum 
-    // total 5bytes, 
-    // check sum = char(SUM(data[0:4)))
-    int data[5] = {0, 0, 0, 0, 0};
-    uint last = 1;
-    uint bit_count = 0;
+    ++stats_.readings;
+    attempt_ = 0;
+    sample_start_ = time_us_32();
+    has_read_ = true;
+    start_attempt();
+}
+
+void dht11::start_attempt()
+{
+    ++stats_.attempts;
+    state_ = dht_state::START_PULSE;
+
+#if DHT11_PIO
+    // state machine back to the first instruction, nothing left from a broken transfer
+    pio_sm_set_enabled(pio_, sm_, false);
+    pio_sm_clear_fifos(pio_, sm_);
+    pio_sm_restart(pio_, sm_);
+    pio_sm_exec(pio_, sm_, pio_encode_jmp(offset_));
+#endif
 
     // pull down data pin > 18ms, start receive ready
     gpio_set_dir(data_pin_, GPIO_OUT);
     gpio_put(data_pin_, 0);               
-    sleep_ms(20);
+    set_alarm(DHT_START_PULSE_US);
+}
+
+void dht11::start_receive()
+{
+    uint32_t start = time_us_32();
+    state_ = dht_state::RECEIVING;
+    edge_count_ = 0;
 
     // change to receive mode         
     gpio_set_dir(data_pin_, GPIO_IN);
-    sleep_us(1);
+    receive_start_ = time_us_32();
 
     /* 
     DHT response starts with low(80us) + up(80us) = 160us
     then followed by data stream    '0': low(50us) + up(28us) = 78us
                                     '1': low(50us) + up(70us) = 120us
-    so response contains: 41 voltage filps, gpio reading times is 82
     one reading max_time = 160 + 120 * 40 = 4.96ms, 
                 min_time = 160 + 78 * 40 = 3.28ms
     */
 
-    for (uint i = 0; i < MAX_TIMINGS; i++)
+#if DHT11_PIO
+    // the state machine times the bits, the alarm looks at the RX FIFO once the transfer may be over
+    pio_sm_set_enabled(pio_, sm_, true);
+    set_alarm(DHT_TRANSFER_MIN_US);
+#else
+    // our own start pulse is no edge of the response
+    gpio_acknowledge_irq(data_pin_, GPIO_IRQ_EDGE_FALL);
+    gpio_set_irq_enabled(data_pin_, GPIO_IRQ_EDGE_FALL, true);
+    set_alarm(DHT_TRANSFER_TIMEOUT_US);
+#endif
+    stats_.cpu_us += time_us_32() - start;
+}
+
+void dht11::finish_attempt()
+{
+    uint32_t start = time_us_32();
+#if DHT11_PIO
+    pio_sm_set_enabled(pio_, sm_, false);
+#else
+    gpio_set_irq_enabled(data_pin_, GPIO_IRQ_EDGE_FALL, false);
+#endif
+
+    dht_reading result;
+    bool ok = do_read(result) && is_read_data_reasonable(result);
+    stats_.cpu_us += time_us_32() - start;
+    if (ok)
+    {
+        reading_ = result;
+        ring_.push({result, time_us_32()});
+    }
+    else
     {
-        uint count = 0;     // count time
-        while (gpio_get(data_pin_) == last)
+        ++stats_.failures;
+        if (++attempt_ < RETRY_TIMES)
         {
-            count++;
-            sleep_us(1);
-            if (count == 255) break;    // overtime
+            start_attempt();
+            return;
         }
+    }
+
+    if (sampling_)
+    {
+        // the interval runs from the start of a reading to the start of the next one
+        state_ = dht_state::SAMPLE_WAIT;
+        uint32_t elapsed = time_us_32() - sample_start_;
+        set_alarm(elapsed < sample_interval_us_ ? sample_interval_us_ - elapsed : 0);
+    }
+    else
+    {
+        state_ = dht_state::DONE;
+    }
+    if (callback_)
+    {
+        callback_(reading_, ok, user_data_);
+    }
+}
 
-        last = gpio_get(data_pin_);
-        if (count == 255) break;
+void dht11::set_alarm(uint32_t delay_us)
+{
+    alarm_at_ = time_us_32() + delay_us;
+    if (hardware_alarm_set_target(alarm_, make_timeout_time_us(delay_us)))
+    {
+        // already past, the alarm would never fire
+        alarm_callback(alarm_);
+    }
+}
 
-        // previous 1 voltage filp is DHT response, not data
-        if ((i >= 4) && (i % 2 == 0)) 
-        {
-            data[bit_count / 8] <<= 1;
-            // DHT11 is very sensitivity to the time delay, 
-            // so the count value should depend on the actual situation
-            // github https://github.com/raspberrypi/pico-examples/issues/11
-            if (count > 30) 
-            {
-                data[bit_count / 8] |= 1;
-            }
-            bit_count++;
-        }   
+void dht11::alarm_callback(uint alarm_num)
+{
+    dht11* self = instance_;
+    if (!self || int32_t(time_us_32() - self->alarm_at_) < 0)
+    {
+        return;
     }
 
-    // check sum
-    if (bit_count >= 40 && (((data[0] + data[1] + data[2] + data[3]) & 0xff) == data[4]))
+    if (self->state_ == dht_state::START_PULSE)
+    {
+        self->start_receive();
+        return;
+    }
+    if (self->state_ == dht_state::SAMPLE_WAIT)
+    {
+        self->begin_reading();
+        return;
+    }
+    if (self->state_ != dht_state::RECEIVING)
+    {
+        return;
+    }
+
+#if DHT11_PIO
+    bool full = pio_sm_get_rx_fifo_level(self->pio_, self->sm_) >= DHT_BYTES;
+    if (!full && time_us_32() - self->receive_start_ < DHT_TRANSFER_TIMEOUT_US)
+    {
+        self->set_alarm(DHT_POLL_US);
+        return;
+    }
+#endif
+    // bytes collected or no response in time
+    self->finish_attempt();
+}
+
+void dht11::gpio_irq_handler()
+{
+    uint32_t now = time_us_32();
+    dht11* self = instance_;
+    if (!self || !(gpio_get_irq_event_mask(self->data_pin_) & GPIO_IRQ_EDGE_FALL))
+    {
+        return;
+    }
+
+    gpio_acknowledge_irq(self->data_pin_, GPIO_IRQ_EDGE_FALL);
+    if (self->state_ != dht_state::RECEIVING || self->edge_count_ >= DHT_EDGES)
+    {
+        return;
+    }
+
+    self->edges_us_[self->edge_count_] = now;
+    if (++self->edge_count_ == DHT_EDGES)
     {
-        result.humidity = data[0] + data[1] / 10.0;
-        result.humidity = result.humidity > 100 ? data[0] : result.humidity;
+        hardware_alarm_cancel(self->alarm_);
+        self->finish_attempt();
+        return;
+    }
+    self->stats_.cpu_us += time_us_32() - now;
+}
+
 
-        result.temp = data[2] + data[3] / 10.0;
-        result.temp = result.temp > 125 ? data[2] : result.temp;
+bool dht11::do_read(dht_reading& result)
+{
+    // DHT data format: 
+    // data[0:4] = 1byte humidity int part | 1byte humidity fraction part | 1byte temp int part | 1byte temp fraction part | check sum 
+    // total 5bytes, 
+    // check sum = char(SUM(data[0:4)))
+    uint8_t data[DHT_BYTES] = {0, 0, 0, 0, 0};
+    uint bit_count = 0;
 
-        // negative temperature
-        if (data[2] & 0x80)
+#if DHT11_PIO
+    for (uint i = 0; i < DHT_BYTES && !pio_sm_is_rx_fifo_empty(pio_, sm_); i++, bit_count += 8)
+    {
+        data[i] = pio_sm_get(pio_, sm_);
+    }
+#else
+    // a bit is the time between the falling edges around it, the low part is always 50us,
+    // interrupt latency only matters when it changes by more than 20us from edge to edge
+    // the first edge starts the response, the second the first bit
+    for (uint i = 2; i < edge_count_; i++, bit_count++)
+    {
+        data[bit_count / 8] <<= 1;
+        if (edges_us_[i] - edges_us_[i - 1] > DHT_BIT_ONE_US)
         {
-            result.temp *= -1;
+            data[bit_count / 8] |= 1;
         }
-        return true;
     }
-    return false;
+#endif
+
+    return bit_count >= 40 && decode(data, result);
+}
+
+
+bool dht11::decode(const uint8_t* data, dht_reading& result)
+{
+    // check sum
+    if (((data[0] + data[1] + data[2] + data[3]) & 0xff) != data[4])
+    {
+        return false;
+    }
+
+    // the fraction byte is tenths, dropped when the sum is out of range
+    int16_t humidity = data[0] * 10 + data[1];
+    result.humidity_x10 = humidity > 1000 ? data[0] * 10 : humidity;
+
+    int16_t temp = (data[2] & 0x7f) * 10 + data[3];
+    result.temp_x10 = temp > 1250 ? (data[2] & 0x7f) * 10 : temp;
+
+    // negative temperature
+    if (data[2] & 0x80)
+    {
+        result.temp_x10 = -result.temp_x10;
+    }
+    return true;
 }
 
 
@@ -166,5 +450,5 @@ bool dht11::is_read_data_reasonable(dht_reading& r)
     set the temperature limit 70 degrees celsius
     0 < humidity <= 100 
     */
-   return r.temp < 70 && r.humidity <= 100 && r.humidity > 0;
-}
\ No newline at end of file
+   return r.temp_x10 < 700 && r.humidity_x10 <= 1000 && r.humidity_x10 > 0;
+}
@@ -2,59 +2,189 @@
 #define DHT11_H_
 
 #include <pico/stdlib.h>
+#include <hardware/pio.h>
 #include <stdio.h>
-#include <queue>
-#include <list>
+#include "sample_ring.h"
+#include "reading_filter.h"
 
 /* 
 dht11 driver, initialized with gpio15
+
+a reading runs in the background: start_read() pulls the line down, a hardware alarm ends the start pulse,
+the bits are timed by the PIO state machine (DHT11_PIO) or by falling edge interrupt timestamps.
+failed attempts are retried from the interrupt, the caller polls poll() or gets the read callback.
+the blocking getters start a reading and wait for it.
+
+start_sampling() keeps reading at a fixed interval from the alarm, nothing to do for the caller.
+good readings go through a lock free ring from the interrupt to the filter, the get_filtered_* getters
+never touch the sensor, they take the new readings from the ring and return the filtered value and its age.
 */
 
+// 1 decodes the bits with a PIO state machine, 0 times them with falling edge interrupts
+#ifndef DHT11_PIO
+#define DHT11_PIO 1
+#endif
+
 const uint RETRY_TIMES = 3;     // retry times when error data arrived
-const uint MAX_TIMINGS = 85;    
+const uint DHT_BYTES = 5;                       // 2 bytes humidity, 2 bytes temperature, check sum
+const uint DHT_TRANSFER_MIN_US = 3300;          // response + 40 '0' bits
+const uint DHT_TRANSFER_TIMEOUT_US = 6000;      // response + 40 '1' bits is 4.96ms
+const uint DHT_START_PULSE_US = 20000;          // > 18ms
+const uint DHT_POLL_US = 200;                   // RX FIFO check interval once the transfer may be over
+const uint DHT_EDGES = 2 + 40;                  // falling edges: response, 40 bit starts, end of the last bit
+const uint DHT_BIT_ONE_US = 100;                // falling edge to falling edge, '0' 78us, '1' 120us
+const uint DHT_SAMPLE_INTERVAL_MS = 1000;       // DHT11 sampling period >= 1s
+const uint DHT_RING_SIZE = 8;                   // readings the ring keeps until the main loop takes them
+const uint DHT_FILTER_SIZE = 5;                 // filter window, readings
+const uint32_t DHT_NO_SAMPLE_AGE = UINT32_MAX;  // age before the first reading
 
+/*
+fixed point, tenths of a degree celsius and tenths of %RH, the resolution of the sensor
+decode, checks, filter and output stay in integers, no software float on the RP2040
+*/
 struct dht_reading
 {
-    // default value
-    double temp = 25;
-    double humidity = 25;
+    // default value, 25.0
+    int16_t temp_x10 = 250;
+    int16_t humidity_x10 = 250;
+
+    double get_temp() const { return temp_x10 / 10.0; }
+    double get_humidity() const { return humidity_x10 / 10.0; }
 };
 
+struct dht_sample
+{
+    dht_reading reading;
+    uint32_t time_us;       // reading finished
+};
+
+struct dht_stats
+{
+    uint32_t readings = 0;          // start_read() calls and sampler readings
+    uint32_t attempts = 0;          // start pulses, a retry is one more attempt
+    uint32_t failures = 0;          // no response, check sum error or unreasonable data
+    uint64_t cpu_us = 0;            // core busy in the interrupts of a reading, the waits left out
+};
+
+enum class dht_state { IDLE, START_PULSE, RECEIVING, DONE, SAMPLE_WAIT };
+
+// called in interrupt context when a reading is over, ok is false after RETRY_TIMES failed attempts
+typedef void (*dht_read_callback_t)(const dht_reading& r, bool ok, void* user_data);
+
 
 class dht11
 {
 public:
-    dht11(uint8_t data_pin);
+    dht11(uint8_t data_pin, PIO pio = pio0);
     ~dht11();
 
 public:
-    void init_dev();        // set gpio pin, put device to state read ready
-    double get_temp();
+    void init_dev();        // set gpio pin, put device to state read ready, interrupts are handled by the calling core
+
+    /*
+    start a reading in the background, with retries
+    @return false if a reading is in flight
+    */
+    bool start_read();
+
+    /*
+    collect a finished reading, the result goes to get_temp_and_humidity() and the filter
+    @return true once per finished reading, ok or not
+    */
+    bool poll();
+    bool is_reading() const { return state_ != dht_state::IDLE && state_ != dht_state::DONE; }
+    void set_read_callback(dht_read_callback_t callback, void* user_data);
+
+    /*
+    read the sensor every interval_ms in the background, start_read() is refused meanwhile
+    the first reading waits until interval_ms after the start of the last one, the sensor needs the rest
+    the read callback is called for every reading, the blocking getters return the last reading
+    */
+    void start_sampling(uint32_t interval_ms = DHT_SAMPLE_INTERVAL_MS);
+    void stop_sampling();
+    bool is_sampling() const { return sampling_; }
+    uint32_t get_samples() const { return ring_.get_pushed(); }        // good readings
+    uint32_t get_lost_samples() const { return ring_.get_lost(); }     // dropped, the ring was full
+
+    double get_temp();          // double accessors, dht_reading has the tenths
     double get_humidity();
     dht_reading& get_temp_and_humidity();
 
     // 方法一：需要使用定时器持续不断的读取数据，并进行存储，入队列，然后再计算出平均值，调用函数只是取出数据，并不从传感器处获得数据
     // 方法二：快速的读取几个数据，然后求平均值
-    double get_filtered_temp();
-    double get_filtered_humidity();
-    dht_reading get_filtered_temp_and_humidity();
+    // method one, with start_sampling(). no sensor access, filter of the last DHT_FILTER_SIZE good readings
+    // @param age_ms if not nullptr, ms since the newest reading in the average, DHT_NO_SAMPLE_AGE if there is none
+    double get_filtered_temp(uint32_t* age_ms = nullptr);
+    double get_filtered_humidity(uint32_t* age_ms = nullptr);
+    dht_reading get_filtered_temp_and_humidity(uint32_t* age_ms = nullptr);
+
+    // moving average by default, median rejects single bad readings
+    void set_filter_mode(filter_mode mode);
+
+    // retry rate = (attempts - readings) / readings, cpu time per reading = cpu_us / readings
+    const dht_stats& get_stats() const { return stats_; }
 
 private:
     void read_from_dht();   // get error data three times, use the last read value
 
+    void begin_reading();   // a reading of up to RETRY_TIMES attempts
+    void start_attempt();   // pull down the data pin, the alarm ends the start pulse
+    void start_receive();   // release the data pin, arm the decoder
+    void finish_attempt();  // stop the decoder, retry or report
+
     /* 
-    read data from dht11
+    read data from dht11, post processing of an attempt
     @param r store dht_reading result (temperature, humidity)
     @return true if reading is succeed, but not care whether the result is reasonable 
     */
     bool do_read(dht_reading& r);
     bool is_read_data_reasonable(dht_reading& r);
 
+    // check sum and conversion of the 5 bytes
+    bool decode(const uint8_t* data, dht_reading& r);
+
+    void update_filter();   // new readings from the ring to the filter
+    uint32_t get_age_ms() const;
+
+    void set_alarm(uint32_t delay_us);
+    static void alarm_callback(uint alarm_num);
+    static void gpio_irq_handler();
+
 private:
     uint8_t data_pin_;
+    PIO pio_;
+    uint sm_ = 0;
+    uint offset_ = 0;
+    uint alarm_ = 0;
     dht_reading result_;
+    dht_stats stats_;
+
+    // owned by the interrupts while a reading is in flight
+    volatile dht_state state_ = dht_state::IDLE;
+    uint attempt_ = 0;
+    uint32_t alarm_at_ = 0;             // alarm target, an early alarm interrupt is ignored
+    uint32_t receive_start_ = 0;
+    uint32_t edges_us_[DHT_EDGES];      // falling edge timestamps
+    volatile uint edge_count_ = 0;
+    dht_reading reading_;
+    volatile bool sampling_ = false;
+    uint32_t sample_interval_us_ = DHT_SAMPLE_INTERVAL_MS * 1000;
+    uint32_t sample_start_ = 0;         // start of the last reading, blocking or background
+    bool has_read_ = false;             // sample_start_ is valid
+
+    // interrupt -> main loop
+    sample_ring<dht_sample, DHT_RING_SIZE> ring_;
+    dht_reading filtered_;              // of the filters, updated with them
+    uint32_t newest_us_ = 0;
+    bool has_sample_ = false;
+
+    dht_read_callback_t callback_ = nullptr;
+    void* user_data_ = nullptr;
+
+    static dht11* instance_;            // irq handlers can not carry user data
 
-    std::list<dht_reading> result_list_;
+    reading_filter<int16_t, DHT_FILTER_SIZE, int32_t> temp_filter_;
+    reading_filter<int16_t, DHT_FILTER_SIZE, int32_t> humidity_filter_;
 };
 
 
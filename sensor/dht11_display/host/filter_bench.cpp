@@ -0,0 +1,203 @@
+/*
+PC side benchmark and check of the reading filter (reading_filter.h), no hardware needed
+a random walk of temperatures in tenths of a degree with sensor spikes is fed to:
+    std::list average       the filter dht11 used before, one allocation per reading
+    reading_filter          every mode, double and the int16 tenths / int32 sum of dht11
+every mode is checked against a brute force filter of the same window, the int16 filter within rounding (0.5 tenth),
+and no filter may allocate.
+
+build: g++ -O2 -std=c++17 -o filter_bench filter_bench.cpp
+usage: filter_bench, exit 1 on a mismatch or an allocation
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <chrono>
+#include <list>
+#include <new>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "../reading_filter.h"
+
+const size_t FILTER_SIZE = 5;           // DHT_FILTER_SIZE in dht11.h
+const size_t BENCH_READINGS = 2000000;
+const size_t CHECK_READINGS = 100000;
+
+static const char* mode_names[] = {"moving average", "median", "ema"};
+static const filter_mode modes[] = {filter_mode::MOVING_AVERAGE, filter_mode::MEDIAN, filter_mode::EMA};
+
+
+// every heap allocation of the program is counted
+static size_t allocations = 0;
+
+void* operator new(size_t n)
+{
+    ++allocations;
+    void* p = malloc(n);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+
+// the filter dht11 used before, average of a list of the last readings
+struct list_filter
+{
+    std::list<double> readings;
+
+    double push_get(double x)
+    {
+        readings.push_back(x);
+        if (readings.size() > FILTER_SIZE)
+        {
+            readings.pop_front();
+        }
+        double sum = 0;
+        for (double r : readings)
+        {
+            sum += r;
+        }
+        return sum / readings.size();
+    }
+};
+
+
+// tenths of a degree, a random walk from 20.0 with a 15 degree spike every 50 readings or so, below zero too
+static std::vector<int16_t> make_readings(size_t count)
+{
+    std::mt19937 rng(1);
+    std::vector<int16_t> out(count);
+    int t = 200;
+    for (auto& x : out)
+    {
+        t = std::clamp(t + int(rng() % 7) - 3, -100, 500);
+        x = int16_t(t + (rng() % 50 == 0 ? 150 : 0));
+    }
+    return out;
+}
+
+// filter of readings[0..i] recomputed from the window, EMA state carried by the caller
+static double reference(filter_mode mode, const std::vector<double>& readings, size_t i, double& ema)
+{
+    size_t n = i + 1 < FILTER_SIZE ? i + 1 : FILTER_SIZE;
+    std::vector<double> window(readings.begin() + (i + 1 - n), readings.begin() + (i + 1));
+    switch (mode)
+    {
+    case filter_mode::MEDIAN:
+        std::sort(window.begin(), window.end());
+        return window[n / 2];
+    case filter_mode::EMA:
+        ema = i == 0 ? readings[0] : ema + (readings[i] - ema) * 2 / (FILTER_SIZE + 1);
+        return ema;
+    default:
+        double sum = 0;
+        for (double r : window)
+        {
+            sum += r;
+        }
+        return sum / n;
+    }
+}
+
+// readings with a larger difference to the reference than tolerance
+template<typename T, typename Sum>
+static size_t check_filter(filter_mode mode, const std::vector<T>& input, double tolerance)
+{
+    std::vector<double> readings(input.begin(), input.end());
+    reading_filter<T, FILTER_SIZE, Sum> filter(mode);
+    double ema = 0;
+    double worst = 0;
+    size_t mismatches = 0;
+    for (size_t i = 0; i < readings.size(); i++)
+    {
+        filter.push(input[i]);
+        double expected = reference(mode, readings, i, ema);
+        double error = std::fabs(double(filter.get()) - expected);
+        worst = std::max(worst, error);
+        if (error > tolerance && mismatches++ < 3)
+        {
+            printf("  %s: reading %d, got %.4f, expected %.4f\n", mode_names[int(mode)], int(i), double(filter.get()), expected);
+        }
+    }
+    printf("%-14s %-6s worst difference %.4f, %d mismatches\n", mode_names[int(mode)], sizeof(T) == 2 ? "int16" : "double",
+           worst, int(mismatches));
+    return mismatches;
+}
+
+template<typename F>
+static double ns_per_reading(F run)
+{
+    auto start = std::chrono::steady_clock::now();
+    run();
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_READINGS;
+}
+
+// per reading cost, allocations of the filter counted in failed
+template<typename T, typename Sum>
+static void bench_filter(filter_mode mode, const std::vector<T>& input, size_t& failed)
+{
+    volatile T sink = T();
+    size_t before = allocations;
+    reading_filter<T, FILTER_SIZE, Sum> filter(mode);
+    double ns = ns_per_reading([&]
+    {
+        for (T x : input)
+        {
+            filter.push(x);
+            sink = filter.get();
+        }
+    });
+    size_t allocated = allocations - before;
+    printf("%-14s %-6s %6.1f ns/reading, %d allocations\n", mode_names[int(mode)], sizeof(T) == 2 ? "int16" : "double",
+           ns, int(allocated));
+    failed += allocated;
+    (void)sink;
+}
+
+
+int main()
+{
+    std::vector<int16_t> tenths = make_readings(BENCH_READINGS);
+    std::vector<double> degrees(tenths.size());
+    std::transform(tenths.begin(), tenths.end(), degrees.begin(), [](int16_t t) { return t / 10.0; });
+
+    printf("== check, %d readings, window %d\n", int(CHECK_READINGS), int(FILTER_SIZE));
+    size_t failed = 0;
+    std::vector<int16_t> check_tenths(tenths.begin(), tenths.begin() + CHECK_READINGS);
+    std::vector<double> check_degrees(degrees.begin(), degrees.begin() + CHECK_READINGS);
+    for (filter_mode mode : modes)
+    {
+        failed += check_filter<double, double>(mode, check_degrees, 1e-9);
+        failed += check_filter<int16_t, int32_t>(mode, check_tenths, 0.51);
+    }
+
+    printf("== bench, %d readings\n", int(BENCH_READINGS));
+    volatile double sink = 0;
+    list_filter old;
+    size_t before = allocations;
+    double ns = ns_per_reading([&]
+    {
+        for (double x : degrees)
+        {
+            sink = old.push_get(x);
+        }
+    });
+    printf("%-21s %6.1f ns/reading, %d allocations\n", "std::list average", ns, int(allocations - before));
+    (void)sink;
+
+    for (filter_mode mode : modes)
+    {
+        bench_filter<double, double>(mode, degrees, failed);
+        bench_filter<int16_t, int32_t>(mode, tenths, failed);
+    }
+
+    printf(failed ? ">> FAILED\n" : ">> ok\n");
+    return failed ? 1 : 0;
+}
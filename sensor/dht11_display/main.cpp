@@ -37,6 +37,8 @@ auto i2c_instance = i2c1;
 const uint LED_PIN = PICO_DEFAULT_LED_PIN;
 bool is_led_on = true;
 
+const uint STATS_INTERVAL = 60;     // readings between two dht11 statistics reports
+
 /*
 output style:
 TEMP = 13.32℃
@@ -45,6 +47,7 @@ RH = 78.21%
 std::string format_dht_output(dht_reading& result);
 std::string format_dht_output_v2(dht_reading& result);
 std::string format_uart_output(dht_reading& result);
+std::string format_tenths(int32_t tenths);
 void write_to_uart(const std::string& msg);
 
 int main()
@@ -92,11 +95,32 @@ int main()
     gpio_put(LED_PIN, 1);
 
 
+    // the first reading blocks, the sampler starts one interval after it and reads in the background while the oled and uart are updated
+    dht11_one.get_temp_and_humidity();
+    dht11_one.start_sampling();
+    uint loop_count = 0;
+    uint32_t getter_max_us = 0;
     while (1)
     {
         // auto result = dht11_one.get_temp_and_humidity(); // no filter
-        auto result = dht11_one.get_filtered_temp_and_humidity(); // with filter
-        printf("Humidity = %.1f%%, Temperture = %.1fC \n", result.humidity, result.temp);
+        uint32_t age_ms = 0;
+        uint32_t getter_start = time_us_32();
+        auto result = dht11_one.get_filtered_temp_and_humidity(&age_ms); // with filter, no sensor access
+        uint32_t getter_us = time_us_32() - getter_start;
+        getter_max_us = getter_us > getter_max_us ? getter_us : getter_max_us;
+
+        printf("Humidity = %s%%, Temperture = %sC, %dms old \n", format_tenths(result.humidity_x10).c_str(),
+            format_tenths(result.temp_x10).c_str(), age_ms);
+        if (++loop_count % STATS_INTERVAL == 0)
+        {
+            auto& stats = dht11_one.get_stats();
+            printf(">> dht11 %s: %d readings, retry rate %s%%, %d failures, cpu time %dus per reading\n",
+                DHT11_PIO ? "pio" : "edge irq", stats.readings,
+                format_tenths(1000 * (stats.attempts - stats.readings) / stats.readings).c_str(), stats.failures,
+                (uint32_t)(stats.cpu_us / stats.readings));
+            printf(">> dht11 sampler: %d samples, %d lost, getter max %dus\n",
+                dht11_one.get_samples(), dht11_one.get_lost_samples(), getter_max_us);
+        }
         // std::cout << format_dht_output(result) << '\n';
         
         // send data to oled display
@@ -119,7 +143,7 @@ std::string format_dht_output(dht_reading& result)
     std::ostringstream oss;
     oss << std::fixed;
     oss.precision(1);
-    oss << "TEMP = " << result.temp << "C, RH = " << result.humidity << "%";
+    oss << "TEMP = " << result.get_temp() << "C, RH = " << result.get_humidity() << "%";
     return oss.str();
 }
 */
@@ -128,24 +152,29 @@ std::string format_dht_output(dht_reading& result)
 // 文件尺寸183kb
 std::string format_dht_output_v2(dht_reading& result)
 {
-    // to_string精确到小数点后五位
     std::string output = "TEMP = ";
-    std::string temp = std::to_string(result.temp);
-    output += temp.substr(0, temp.find('.') + 2) + "_@\nRH = "; // ℃占用两个字符，因此为了方便起见，使用_@来替代
-    temp = std::to_string(result.humidity);
-    output += temp.substr(0, temp.find('.') + 2) + "%";
+    output += format_tenths(result.temp_x10) + "_@\nRH = "; // ℃占用两个字符，因此为了方便起见，使用_@来替代
+    output += format_tenths(result.humidity_x10) + "%";
     return output;
 }
 
 
 std::string format_uart_output(dht_reading& result)
 {
-    // to_string精确到小数点后五位
     std::string output = "TEMP = ";
-    std::string temp = std::to_string(result.temp);
-    output += temp.substr(0, temp.find('.') + 2) + ", RH = ";
-    temp = std::to_string(result.humidity);
-    output += temp.substr(0, temp.find('.') + 2) + "%";
+    output += format_tenths(result.temp_x10) + ", RH = ";
+    output += format_tenths(result.humidity_x10) + "%";
+    return output;
+}
+
+
+// tenths to "-12.3", one decimal like the sensor, no float formatting
+std::string format_tenths(int32_t tenths)
+{
+    uint32_t value = tenths < 0 ? -tenths : tenths;
+    std::string output = tenths < 0 ? "-" : "";
+    output += std::to_string(value / 10) + '.';
+    output += char('0' + value % 10);
     return output;
 }
 
@@ -0,0 +1,164 @@
+#ifndef READING_FILTER_H_
+#define READING_FILTER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <type_traits>
+
+/*
+fixed size filter of sensor readings, no heap, the window size N is a template parameter
+the last N readings are kept in a ring, the filter mode picks what get() returns:
+    MOVING_AVERAGE: mean of the window, running sum, O(1) per reading
+    MEDIAN: median of the window, a spike shorter than N / 2 readings never shows, O(N) per reading
+    EMA: exponential moving average, alpha = 2 / (N + 1), the same mean age as the N window, O(1) per reading
+
+T is the reading type, Sum holds the running sum of N readings and the EMA state.
+an integer EMA is kept with 8 fraction bits, small steps are not lost to rounding
+*/
+
+enum class filter_mode : uint8_t { MOVING_AVERAGE, MEDIAN, EMA };
+
+
+template<typename T, size_t N, typename Sum = T>
+class reading_filter
+{
+    static_assert(N > 0, "filter window must not be empty");
+
+public:
+    explicit reading_filter(filter_mode mode = filter_mode::MOVING_AVERAGE) : mode_(mode) {}
+
+    void push(T x)
+    {
+        if (count_ == N)
+        {
+            T old = window_[next_];
+            sum_ -= old;
+            if (mode_ == filter_mode::MEDIAN)
+            {
+                remove_sorted(old);
+            }
+        }
+        else
+        {
+            ++count_;
+        }
+
+        window_[next_] = x;
+        next_ = next_ + 1 == N ? 0 : next_ + 1;
+        sum_ += x;
+
+        if (mode_ == filter_mode::MEDIAN)
+        {
+            insert_sorted(x);
+        }
+        else if (mode_ == filter_mode::EMA)
+        {
+            Sum scaled = Sum(x) * EMA_SCALE;
+            ema_ = count_ == 1 ? scaled : ema_ + divide((scaled - ema_) * 2, Sum(N + 1));
+        }
+    }
+
+    // filtered value, T() before the first reading
+    T get() const
+    {
+        if (!count_)
+        {
+            return T();
+        }
+
+        switch (mode_)
+        {
+        case filter_mode::MEDIAN:
+            return sorted_[count_ / 2];
+        case filter_mode::EMA:
+            return T(divide(ema_, EMA_SCALE));
+        default:
+            return T(divide(sum_, Sum(count_)));
+        }
+    }
+
+    // the window is kept, the median order and the EMA start again from it
+    void set_mode(filter_mode mode)
+    {
+        mode_ = mode;
+        size_t first = count_ == N ? next_ : 0;
+        size_t filled = count_;
+        sorted_count_ = 0;
+        for (size_t i = 0; i < filled; i++)
+        {
+            T x = window_[(first + i) % N];
+            if (mode_ == filter_mode::MEDIAN)
+            {
+                insert_sorted(x);
+            }
+            else if (mode_ == filter_mode::EMA)
+            {
+                Sum scaled = Sum(x) * EMA_SCALE;
+                ema_ = i == 0 ? scaled : ema_ + divide((scaled - ema_) * 2, Sum(N + 1));
+            }
+        }
+    }
+
+    void reset()
+    {
+        count_ = 0;
+        next_ = 0;
+        sorted_count_ = 0;
+        sum_ = Sum();
+        ema_ = Sum();
+    }
+
+    filter_mode get_mode() const { return mode_; }
+    size_t size() const { return count_; }
+    static constexpr size_t capacity() { return N; }
+
+private:
+    static constexpr bool INTEGER = std::is_integral<Sum>::value;
+    static constexpr Sum EMA_SCALE = INTEGER ? Sum(256) : Sum(1);
+
+    // rounded to the nearest for integers, negative values too
+    static Sum divide(Sum a, Sum b)
+    {
+        if (!INTEGER)
+        {
+            return a / b;
+        }
+        return a < 0 ? (a - b / 2) / b : (a + b / 2) / b;
+    }
+
+    void insert_sorted(T x)
+    {
+        size_t i = sorted_count_++;
+        for (; i > 0 && sorted_[i - 1] > x; i--)
+        {
+            sorted_[i] = sorted_[i - 1];
+        }
+        sorted_[i] = x;
+    }
+
+    void remove_sorted(T x)
+    {
+        size_t i = 0;
+        while (i < sorted_count_ && sorted_[i] != x)
+        {
+            i++;
+        }
+        for (--sorted_count_; i < sorted_count_; i++)
+        {
+            sorted_[i] = sorted_[i + 1];
+        }
+    }
+
+private:
+    filter_mode mode_;
+    T window_[N] = {};          // ring, oldest reading at next_ once full
+    T sorted_[N] = {};          // the window in order, MEDIAN only
+    size_t count_ = 0;
+    size_t next_ = 0;
+    size_t sorted_count_ = 0;
+    Sum sum_ = Sum();
+    Sum ema_ = Sum();
+};
+
+
+#endif
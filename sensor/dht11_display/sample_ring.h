@@ -0,0 +1,64 @@
+#ifndef SAMPLE_RING_H_
+#define SAMPLE_RING_H_
+
+#include <pico/stdlib.h>
+#include <hardware/sync.h>
+
+/*
+lock free single producer, single consumer ring
+the producer is an interrupt handler or the other core, the consumer the main loop,
+no lock and no interrupt masking: every index has one writer, the indices run free and wrap
+a full ring drops the new item and counts it as lost
+*/
+
+template<typename T, uint32_t N>
+class sample_ring
+{
+    static_assert(N && (N & (N - 1)) == 0, "ring size must be a power of 2");
+
+public:
+    // producer side
+    bool push(const T& item)
+    {
+        uint32_t head = head_;
+        if (head - tail_ == N)
+        {
+            ++lost_;
+            return false;
+        }
+
+        items_[head & (N - 1)] = item;
+        __dmb();            // the item is written before the consumer can see it
+        head_ = head + 1;
+        return true;
+    }
+
+    // consumer side
+    bool pop(T& item)
+    {
+        uint32_t tail = tail_;
+        if (tail == head_)
+        {
+            return false;
+        }
+
+        __dmb();            // the item is read after its index
+        item = items_[tail & (N - 1)];
+        __dmb();            // and before the producer can write the slot again
+        tail_ = tail + 1;
+        return true;
+    }
+
+    uint32_t size() const { return head_ - tail_; }
+    uint32_t get_pushed() const { return head_; }      // items ever pushed
+    uint32_t get_lost() const { return lost_; }
+
+private:
+    T items_[N];
+    volatile uint32_t head_ = 0;        // written by the producer
+    volatile uint32_t tail_ = 0;        // written by the consumer
+    volatile uint32_t lost_ = 0;        // written by the producer
+};
+
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef ASCII_RENDER_H_
+#define ASCII_RENDER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "reg_config.h"
+
+/*
+greyscale to ascii renderer
+luma -> charmap index is precomputed at compile time, 70 - y / 3.7 == 70 - y * 10 / 37,
+no float and no heap in the per pixel loop, lines are written to one preallocated buffer with '\n'
+a runtime lut is rebuilt per frame through a tone curve for auto contrast, see luma_stats.h
+*/
+
+struct ascii_lut
+{
+    char entry[256];
+
+    constexpr ascii_lut() : entry()
+    {
+        for (uint32_t y = 0; y < 256; y++)
+        {
+            entry[y] = charmap[70 - y * 10 / 37];
+        }
+    }
+
+    // luma -> tone -> char, 256 entries, cheap enough once per frame
+    void build(const uint8_t (&curve)[256])
+    {
+        for (uint32_t y = 0; y < 256; y++)
+        {
+            entry[y] = charmap[70 - curve[y] * 10 / 37];
+        }
+    }
+};
+
+inline constexpr ascii_lut ASCII_LUT{};
+
+
+/*
+render one line, width chars + '\n'
+@param src first luma byte of the line
+@param pixel_bytes distance between two luma bytes, 2 for YUV422
+@return pointer after the '\n'
+*/
+inline char* render_ascii_line(const uint8_t* src, size_t width, size_t pixel_bytes, char* out, const ascii_lut& lut = ASCII_LUT)
+{
+    const uint8_t* end = src + width * pixel_bytes;
+    for (; src != end; src += pixel_bytes)
+    {
+        *out++ = lut.entry[*src];
+    }
+    *out++ = '\n';
+    return out;
+}
+
+
+/*
+render a frame, out holds height * (width + 1) chars
+@return chars written
+*/
+inline size_t render_ascii(const uint8_t* src, size_t width, size_t height, size_t line_bytes, size_t pixel_bytes, char* out,
+                           const ascii_lut& lut = ASCII_LUT)
+{
+    char* p = out;
+    for (size_t i = 0; i < height; i++)
+    {
+        p = render_ascii_line(src + i * line_bytes, width, pixel_bytes, p, lut);
+    }
+    return p - out;
+}
+
+
+#endif
@@ -0,0 +1,137 @@
+#include "capture_scheduler.h"
+#include <hardware/irq.h>
+#include <hardware/sync.h>
+#include <hardware/timer.h>
+#include <hardware/structs/scb.h>
+
+capture_scheduler* capture_scheduler::instance_ = nullptr;
+
+capture_scheduler::capture_scheduler(uint vsync_pin)
+    : vsync_pin_(vsync_pin)
+{
+    critical_section_init(&lock_);
+}
+
+capture_scheduler::~capture_scheduler()
+{
+    if (instance_ == this)
+    {
+        gpio_set_irq_enabled(vsync_pin_, GPIO_IRQ_EDGE_FALL, false);
+        gpio_remove_raw_irq_handler(vsync_pin_, gpio_irq_handler);
+        hardware_alarm_set_callback(alarm_, nullptr);
+        hardware_alarm_unclaim(alarm_);
+        instance_ = nullptr;
+    }
+    critical_section_deinit(&lock_);
+}
+
+void capture_scheduler::init_dev()
+{
+    instance_ = this;
+
+    // a pending interrupt wakes __wfe even while interrupts are masked, see sleep()
+    scb_hw->scr |= M0PLUS_SCR_SEVONPEND_BITS;
+
+    gpio_add_raw_irq_handler(vsync_pin_, gpio_irq_handler);
+    gpio_set_irq_enabled(vsync_pin_, GPIO_IRQ_EDGE_FALL, true);
+    irq_set_enabled(IO_IRQ_BANK0, true);
+
+    // nap() timeout, the alarm interrupt is enabled on the calling core
+    alarm_ = hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback(alarm_, alarm_callback);
+}
+
+void capture_scheduler::set_continuous()
+{
+    mode_ = capture_request::CONTINUOUS;
+}
+
+void capture_scheduler::set_every_nth(uint32_t n)
+{
+    every_ = n ? n : 1;
+    mode_ = capture_request::EVERY_NTH;
+}
+
+void capture_scheduler::set_on_demand()
+{
+    mode_ = capture_request::ON_DEMAND;
+}
+
+void capture_scheduler::request_frames(uint32_t count)
+{
+    // read-modify-write, an interrupt or the other core in between would lose a request
+    critical_section_enter_blocking(&lock_);
+    requested_ += count;
+    critical_section_exit(&lock_);
+    __sev();
+}
+
+bool capture_scheduler::is_due(uint32_t frame) const
+{
+    switch (mode_)
+    {
+    case capture_request::EVERY_NTH:
+        return frame % every_ == 0;
+    case capture_request::ON_DEMAND:
+        return requested_ != granted_;
+    default:
+        return true;
+    }
+}
+
+void capture_scheduler::consume()
+{
+    if (mode_ == capture_request::ON_DEMAND && requested_ != granted_)
+    {
+        ++granted_;
+    }
+}
+
+void capture_scheduler::set_vsync_callback(vsync_callback_t callback, void* user_data)
+{
+    callback_ = callback;
+    user_data_ = user_data;
+}
+
+void capture_scheduler::sleep()
+{
+    // the handler runs on restore_interrupts(), after the wake up is timed
+    uint32_t save = save_and_disable_interrupts();
+    uint32_t start = time_us_32();
+    __wfe();
+    idle_us_ += time_us_32() - start;
+    restore_interrupts(save);
+}
+
+void capture_scheduler::nap(uint32_t timeout_us)
+{
+    // the alarm interrupt of this core is the wake up, like sleep() the handler runs after the wake up is timed
+    uint32_t save = save_and_disable_interrupts();
+    uint32_t start = time_us_32();
+    if (!hardware_alarm_set_target(alarm_, make_timeout_time_us(timeout_us)))
+    {
+        __wfe();
+    }
+    idle_us_ += time_us_32() - start;
+    restore_interrupts(save);
+}
+
+void capture_scheduler::alarm_callback(uint alarm_num)
+{
+    // nothing to do, the interrupt has woken the core
+}
+
+void capture_scheduler::gpio_irq_handler()
+{
+    if (!instance_ || !(gpio_get_irq_event_mask(instance_->vsync_pin_) & GPIO_IRQ_EDGE_FALL))
+    {
+        return;
+    }
+
+    gpio_acknowledge_irq(instance_->vsync_pin_, GPIO_IRQ_EDGE_FALL);
+    ++instance_->vsync_count_;
+    if (instance_->callback_)
+    {
+        instance_->callback_(instance_->user_data_);
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef CAPTURE_SCHEDULER_H_
+#define CAPTURE_SCHEDULER_H_
+
+#include <pico/stdlib.h>
+#include <pico/sync.h>
+
+/*
+event driven capture scheduler
+the VSYNC falling edge interrupt counts sensor frames and gives the capture engine a chance to arm,
+the request mode tells which frames are wanted:
+    CONTINUOUS: every frame
+    EVERY_NTH: one frame out of n
+    ON_DEMAND: one frame per request_frames(), requests may come from any core or interrupt,
+               request_frames() takes a critical section so concurrent requests are not lost
+
+the capture core has nothing to do between interrupts, it sleeps in sleep() and the time asleep is counted
+*/
+
+enum class capture_request { CONTINUOUS, EVERY_NTH, ON_DEMAND };
+
+// called in interrupt context on every VSYNC falling edge
+typedef void (*vsync_callback_t)(void* user_data);
+
+
+class capture_scheduler
+{
+public:
+    capture_scheduler(uint vsync_pin);
+    ~capture_scheduler();
+
+public:
+    void init_dev();        // VSYNC interrupt, handled by the calling core
+
+    // request mode, may be changed at any time from any core
+    void set_continuous();
+    void set_every_nth(uint32_t n);
+    void set_on_demand();
+    void request_frames(uint32_t count = 1);
+
+    /*
+    is sensor frame number frame wanted, frames are numbered by VSYNC
+    consume() after the capture of a wanted frame is armed
+    */
+    bool is_due(uint32_t frame) const;
+    void consume();
+
+    void set_vsync_callback(vsync_callback_t callback, void* user_data);
+
+    // sleep until the next interrupt or event, the time asleep counts as idle
+    void sleep();
+    void nap(uint32_t timeout_us);      // sleep until the next interrupt or event, timeout_us at most
+
+    capture_request get_mode() const { return mode_; }
+    uint32_t get_every() const { return every_; }
+    uint32_t get_vsync_count() const { return vsync_count_; }    // sensor frames seen
+    uint32_t get_pending() const { return requested_ - granted_; }
+    uint32_t get_idle_us() const { return idle_us_; }           // wraps, use differences
+
+private:
+    static void gpio_irq_handler();
+    static void alarm_callback(uint alarm_num);
+
+private:
+    uint vsync_pin_;
+    uint alarm_ = 0;
+    volatile capture_request mode_ = capture_request::CONTINUOUS;
+    volatile uint32_t every_ = 1;
+    volatile uint32_t vsync_count_ = 0;
+
+    /*
+    pending requests = requested - granted
+    requested_ is bumped by the main loop and by timer interrupts, every update takes lock_
+    granted_ is only written by consume() on the capture core
+    */
+    volatile uint32_t requested_ = 0;
+    volatile uint32_t granted_ = 0;
+    critical_section_t lock_;
+
+    volatile uint32_t idle_us_ = 0;
+
+    vsync_callback_t callback_ = nullptr;
+    void* user_data_ = nullptr;
+
+    static capture_scheduler* instance_;    // irq handlers can not carry user data
+};
+
+
+#endif
@@ -0,0 +1,223 @@
+#include "delta_codec.h"
+#include <string.h>
+#include <algorithm>
+
+static size_t tiles_x(size_t width) { return (width + DELTA_TILE - 1) / DELTA_TILE; }
+static size_t tiles_y(size_t height) { return (height + DELTA_TILE - 1) / DELTA_TILE; }
+
+// PackBits, n: 0-127 -> n + 1 literals follow, 129-255 -> next byte repeats 257 - n times
+// only runs of 3 or more are worth a run code, so the output is never longer than len + len / 128 + 1
+static size_t run_length(const uint8_t* src, size_t i, size_t len)
+{
+    size_t run = 1;
+    while (i + run < len && run < 128 && src[i + run] == src[i])
+    {
+        run++;
+    }
+    return run;
+}
+
+static uint8_t* pack_bits(const uint8_t* src, size_t len, uint8_t* out)
+{
+    size_t i = 0;
+    while (i < len)
+    {
+        size_t run = run_length(src, i, len);
+        if (run >= 3)
+        {
+            *out++ = uint8_t(257 - run);
+            *out++ = src[i];
+            i += run;
+            continue;
+        }
+
+        // literals until the next run of 3
+        size_t start = i;
+        while (i < len && i - start < 128 && (i == start || run_length(src, i, len) < 3))
+        {
+            i++;
+        }
+        *out++ = uint8_t(i - start - 1);
+        memcpy(out, src + start, i - start);
+        out += i - start;
+    }
+    return out;
+}
+
+static const uint8_t* unpack_bits(const uint8_t* src, const uint8_t* end, uint8_t* dst, size_t len)
+{
+    size_t i = 0;
+    while (i < len)
+    {
+        if (src >= end)
+        {
+            return nullptr;
+        }
+
+        uint8_t n = *src++;
+        if (n < 128)
+        {
+            size_t count = n + 1;
+            if (i + count > len || src + count > end)
+            {
+                return nullptr;
+            }
+            memcpy(dst + i, src, count);
+            src += count;
+            i += count;
+        }
+        else if (n > 128)
+        {
+            size_t count = 257 - n;
+            if (i + count > len || src >= end)
+            {
+                return nullptr;
+            }
+            memset(dst + i, *src++, count);
+            i += count;
+        }
+    }
+    return src;
+}
+
+
+size_t delta_encode(const uint8_t* cur, uint8_t* ref, size_t width, size_t height,
+                    bool keyframe, uint8_t threshold, uint8_t* out)
+{
+    const size_t tx = tiles_x(width);
+    const size_t ty = tiles_y(height);
+    uint8_t* p = out;
+
+    *p++ = keyframe ? DELTA_FLAG_KEYFRAME : 0;
+    uint8_t* map = p;
+    memset(map, 0, (tx * ty + 7) / 8);
+    p += (tx * ty + 7) / 8;
+
+    if (keyframe)
+    {
+        memset(ref, 0, width * height);
+    }
+
+    uint8_t delta[DELTA_TILE * DELTA_TILE];
+    for (size_t t = 0; t < tx * ty; t++)
+    {
+        const size_t x0 = (t % tx) * DELTA_TILE;
+        const size_t y0 = (t / tx) * DELTA_TILE;
+        const size_t w = (x0 + DELTA_TILE <= width) ? DELTA_TILE : width - x0;
+        const size_t h = (y0 + DELTA_TILE <= height) ? DELTA_TILE : height - y0;
+
+        int max_delta = 0;
+        size_t n = 0;
+        for (size_t y = y0; y < y0 + h; y++)
+        {
+            const uint8_t* c = cur + y * width + x0;
+            const uint8_t* r = ref + y * width + x0;
+            for (size_t x = 0; x < w; x++)
+            {
+                int d = int(c[x]) - int(r[x]);
+                max_delta = std::max(max_delta, d < 0 ? -d : d);
+                // small changes are noise, drop them
+                delta[n++] = (d <= threshold && d >= -threshold) ? 0 : uint8_t(d);
+            }
+        }
+
+        if (!keyframe && max_delta <= threshold)
+        {
+            continue;
+        }
+
+        map[t / 8] |= 1u << (t % 8);
+        p = pack_bits(delta, n, p);
+
+        // the decoder adds the same delta
+        n = 0;
+        for (size_t y = y0; y < y0 + h; y++)
+        {
+            uint8_t* r = ref + y * width + x0;
+            for (size_t x = 0; x < w; x++)
+            {
+                r[x] += delta[n++];
+            }
+        }
+    }
+    return p - out;
+}
+
+
+bool delta_decode(const uint8_t* payload, size_t len, uint8_t* ref, size_t width, size_t height)
+{
+    const size_t tx = tiles_x(width);
+    const size_t ty = tiles_y(height);
+    const size_t map_len = (tx * ty + 7) / 8;
+    const uint8_t* end = payload + len;
+
+    if (len < 1 + map_len)
+    {
+        return false;
+    }
+    if (payload[0] & DELTA_FLAG_KEYFRAME)
+    {
+        memset(ref, 0, width * height);
+    }
+
+    const uint8_t* map = payload + 1;
+    const uint8_t* p = map + map_len;
+    uint8_t delta[DELTA_TILE * DELTA_TILE];
+
+    for (size_t t = 0; t < tx * ty; t++)
+    {
+        if (!(map[t / 8] & (1u << (t % 8))))
+        {
+            continue;
+        }
+
+        const size_t x0 = (t % tx) * DELTA_TILE;
+        const size_t y0 = (t / tx) * DELTA_TILE;
+        const size_t w = (x0 + DELTA_TILE <= width) ? DELTA_TILE : width - x0;
+        const size_t h = (y0 + DELTA_TILE <= height) ? DELTA_TILE : height - y0;
+
+        p = unpack_bits(p, end, delta, w * h);
+        if (!p)
+        {
+            return false;
+        }
+
+        size_t n = 0;
+        for (size_t y = y0; y < y0 + h; y++)
+        {
+            uint8_t* r = ref + y * width + x0;
+            for (size_t x = 0; x < w; x++)
+            {
+                r[x] += delta[n++];
+            }
+        }
+    }
+    return p == end;
+}
+
+
+delta_encoder::delta_encoder(uint8_t* ref, size_t width, size_t height, uint32_t keyframe_interval, uint8_t threshold)
+    : ref_(ref)
+    , width_(width)
+    , height_(height)
+    , keyframe_interval_(keyframe_interval)
+    , frames_since_keyframe_(keyframe_interval)   // the first frame is a keyframe
+    , threshold_(threshold)
+{
+}
+
+delta_encoder::~delta_encoder() {}
+
+size_t delta_encoder::encode(const uint8_t* cur, uint8_t* out)
+{
+    last_keyframe_ = frames_since_keyframe_ >= keyframe_interval_;
+    frames_since_keyframe_ = last_keyframe_ ? 1 : frames_since_keyframe_ + 1;
+    return delta_encode(cur, ref_, width_, height_, last_keyframe_, threshold_, out);
+}
+
+void delta_encoder::set_size(size_t width, size_t height)
+{
+    width_ = width;
+    height_ = height;
+    request_keyframe();
+}
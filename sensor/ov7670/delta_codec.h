@@ -0,0 +1,83 @@
+#ifndef DELTA_CODEC_H_
+#define DELTA_CODEC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+inter-frame delta codec, shared by the firmware and the PC side tools (host/)
+the plane (width x height bytes) is cut into 8x8 byte tiles, only the tiles that changed
+against the reference frame are sent, each tile as PackBits run-length code of (current - reference).
+
+payload:
+byte 0              flags, DELTA_FLAG_KEYFRAME: reference is all zero
+tile map            1 bit per tile, row major, LSB first, set = tile follows
+tiles               PackBits of the tile delta, row by row
+
+threshold: a tile is sent if any |delta| is above threshold, inside a sent tile |delta| <= threshold is dropped,
+so the decoded frame never differs more than threshold from the source, threshold 0 is lossless.
+encoder and decoder keep the same reference, the encoder updates it with what the decoder will see.
+*/
+
+const size_t DELTA_TILE = 8;
+const uint8_t DELTA_FLAG_KEYFRAME = 0x01;
+
+constexpr size_t delta_tile_count(size_t width, size_t height)
+{
+    return ((width + DELTA_TILE - 1) / DELTA_TILE) * ((height + DELTA_TILE - 1) / DELTA_TILE);
+}
+
+// worst case, every tile sent as literals, one PackBits control byte every 128 literals
+constexpr size_t delta_max_encoded_size(size_t width, size_t height)
+{
+    return 1 + (delta_tile_count(width, height) + 7) / 8 +
+           delta_tile_count(width, height) * (DELTA_TILE * DELTA_TILE + DELTA_TILE * DELTA_TILE / 128 + 1);
+}
+
+/*
+encode one plane
+@param ref reference plane, updated to the decoded result
+@param out at least delta_max_encoded_size() bytes
+@return encoded bytes
+*/
+size_t delta_encode(const uint8_t* cur, uint8_t* ref, size_t width, size_t height,
+                    bool keyframe, uint8_t threshold, uint8_t* out);
+
+/*
+decode one plane in place
+@param ref reference plane, replaced by the decoded frame
+@return false if the payload is broken
+*/
+bool delta_decode(const uint8_t* payload, size_t len, uint8_t* ref, size_t width, size_t height);
+
+
+// keeps the reference frame and the keyframe schedule of one stream
+class delta_encoder
+{
+public:
+    /*
+    @param ref reference plane buffer, width * height bytes, owned by the caller
+    @param keyframe_interval a keyframe every n frames
+    */
+    delta_encoder(uint8_t* ref, size_t width, size_t height, uint32_t keyframe_interval = 30, uint8_t threshold = 4);
+    ~delta_encoder();
+
+public:
+    size_t encode(const uint8_t* cur, uint8_t* out);
+    void request_keyframe() { frames_since_keyframe_ = keyframe_interval_; }   // e.g. after a broken link
+    void set_threshold(uint8_t threshold) { threshold_ = threshold; }
+    void set_size(size_t width, size_t height);     // ref must hold the new size, next frame is a keyframe
+    bool was_keyframe() const { return last_keyframe_; }
+
+private:
+    uint8_t* ref_;
+    size_t width_;
+    size_t height_;
+    uint32_t keyframe_interval_;
+    uint32_t frames_since_keyframe_;
+    uint8_t threshold_;
+    bool last_keyframe_ = false;
+};
+
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef FRAME_FORMAT_H_
+#define FRAME_FORMAT_H_
+
+#include <stddef.h>
+
+/*
+captured frame geometry
+resolution: 80x60, color format: YUV422 or RGB565, 2 bytes per pixel either way
+YUV422 bytes sequence is Y,U,Y,V,Y,U,Y,V, RGB565 is high byte first
+
+build with OV7670_LUMA_ONLY=1 and only the Y bytes of YUV422 are captured, 1 byte per pixel,
+every frame buffer is half the size, there is no color output
+*/
+
+#ifndef OV7670_LUMA_ONLY
+#define OV7670_LUMA_ONLY 0
+#endif
+
+const size_t FRAME_WIDTH = 80;
+const size_t FRAME_HEIGHT = 60;
+const size_t FRAME_PIXEL_BYTES = OV7670_LUMA_ONLY ? 1 : 2;
+const size_t FRAME_LINE_BYTES = FRAME_WIDTH * FRAME_PIXEL_BYTES;
+const size_t FRAME_BYTES = FRAME_LINE_BYTES * FRAME_HEIGHT;
+
+
+#endif
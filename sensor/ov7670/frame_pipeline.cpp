@@ -0,0 +1,194 @@
+#include "frame_pipeline.h"
+#include <pico/multicore.h>
+#include <hardware/sync.h>
+#include "perf_stats.h"
+
+frame_pipeline* frame_pipeline::instance_ = nullptr;
+
+frame_pipeline::frame_pipeline(pio_capture& camera, capture_scheduler& scheduler)
+    : camera_(camera)
+    , scheduler_(scheduler)
+{
+}
+
+frame_pipeline::~frame_pipeline() {}
+
+void frame_pipeline::start()
+{
+    instance_ = this;
+    multicore_launch_core1(core1_entry);
+}
+
+bool frame_pipeline::acquire_frame(frame_info& frame, uint32_t timeout_us)
+{
+    if (store_.lease_next(acquired_sequence_, frame))
+    {
+        acquired_sequence_ = frame.sequence;
+        return true;
+    }
+    ++consumer_waits_;
+
+    // woken up by the store when core1 publishes a frame
+    absolute_time_t timeout = make_timeout_time_us(timeout_us);
+    while (!store_.lease_next(acquired_sequence_, frame))
+    {
+        if (time_reached(timeout))
+        {
+            return false;
+        }
+        __wfe();
+    }
+    acquired_sequence_ = frame.sequence;
+    return true;
+}
+
+bool frame_pipeline::set_frame_size(uint width, uint height)
+{
+    // dma moves words, a line of an even width is a multiple of 4 bytes, of a multiple of 4 with luma only
+    if (!width || !height || (width * FRAME_PIXEL_BYTES % 4) || width * height * FRAME_PIXEL_BYTES > FRAME_BYTES)
+    {
+        return false;
+    }
+    geometry_ = (width << 16) | height;
+    return true;
+}
+
+void frame_pipeline::set_pixel_format(pixel_format format)
+{
+    format_ = format;
+}
+
+void frame_pipeline::release_frame(const frame_info& frame)
+{
+    store_.release(frame);
+}
+
+void frame_pipeline::core1_entry()
+{
+    instance_->capture_loop();
+}
+
+void frame_pipeline::capture_loop()
+{
+    // dma, pio and gpio interrupts are handled by the core which initializes them
+    camera_.set_frame_callback(frame_callback, this);
+    camera_.init_dev();
+    scheduler_.set_vsync_callback(vsync_callback, this);
+    scheduler_.init_dev();
+
+    // the capture is done in the interrupts, the histogram follows the DMA in between
+    while (true)
+    {
+        if (camera_.is_busy())
+        {
+            update_histogram();
+        }
+        else
+        {
+            scheduler_.sleep();
+        }
+    }
+}
+
+void frame_pipeline::update_histogram()
+{
+    // the DMA interrupt finishes the histogram, it must never see half a chunk
+    uint32_t save = save_and_disable_interrupts();
+    size_t bytes = 0;
+    if (camera_.is_busy())
+    {
+        bytes = camera_.get_bytes_captured();
+        histogram_.feed(bytes, HISTOGRAM_CHUNK_BYTES);
+    }
+    bool behind = histogram_.get_done() + 4 <= bytes;
+    restore_interrupts(save);
+
+    if (!behind)
+    {
+        scheduler_.nap(HISTOGRAM_NAP_US);
+    }
+}
+
+void frame_pipeline::vsync_callback(void* user_data)
+{
+    static_cast<frame_pipeline*>(user_data)->on_vsync();
+}
+
+void frame_pipeline::frame_callback(uint8_t* buf, size_t len, void* user_data)
+{
+    static_cast<frame_pipeline*>(user_data)->on_frame_captured();
+}
+
+void frame_pipeline::on_vsync()
+{
+    if (camera_.is_busy())
+    {
+        // a capture armed before the previous VSYNC must be complete by now, PCLK or HREF is lost
+        if (scheduler_.get_vsync_count() - armed_vsync_ < 2)
+        {
+            return;
+        }
+        // the lines in memory stay readable by sequence
+        size_t lines = camera_.get_bytes_captured() / ((armed_geometry_ >> 16) * FRAME_PIXEL_BYTES);
+        camera_.abort_capture();
+        store_.end_write(armed_slot_, frame_status::ABORTED, camera_.get_frame_start_us(), lines);
+        ++dropped_frames_;
+        ++capture_errors_;
+    }
+    try_arm();
+}
+
+void frame_pipeline::on_frame_captured()
+{
+    ++captured_frames_;
+    // a few bytes came after the last update, the frame goes out with its statistics
+    histogram_.finish((armed_geometry_ >> 16) * (armed_geometry_ & 0xffff) * FRAME_PIXEL_BYTES);
+    perf_record(perf_stage::VSYNC_TO_PIXEL, camera_.get_first_pixel_us() - camera_.get_frame_start_us());
+    perf_record(perf_stage::CAPTURE, camera_.get_capture_time_us());
+    store_.end_write(armed_slot_, frame_status::COMPLETE, camera_.get_frame_start_us(), armed_geometry_ & 0xffff);
+
+    // the sensor is in vertical blanking, the next frame can still be armed
+    try_arm();
+}
+
+void frame_pipeline::try_arm()
+{
+    // the engine starts at the next VSYNC falling edge
+    uint32_t frame = scheduler_.get_vsync_count() + 1;
+    if (!scheduler_.is_due(frame))
+    {
+        return;
+    }
+
+    // the oldest slot nobody reads
+    uint32_t geometry = geometry_;
+    int slot = store_.begin_write(sequence_ + 1, geometry >> 16, geometry & 0xffff);
+    if (slot < 0)
+    {
+        // readers hold every slot, the wanted frame passes by, counted once
+        if (frame != starved_frame_)
+        {
+            starved_frame_ = frame;
+            ++buffer_starvation_;
+            if (scheduler_.get_mode() != capture_request::ON_DEMAND)
+            {
+                ++dropped_frames_;  // on demand requests stay pending instead
+            }
+        }
+        return;
+    }
+
+    // only the bytes of the region of interest are captured
+    armed_slot_ = slot;
+    armed_vsync_ = frame - 1;
+    armed_geometry_ = geometry;
+    size_t len = (geometry >> 16) * (geometry & 0xffff) * FRAME_PIXEL_BYTES;
+    histogram_.begin(store_.get_data(slot), format_, store_.get_stats(slot));
+    if (!camera_.start_capture(store_.get_data(slot), len))
+    {
+        store_.end_write(slot, frame_status::EMPTY, 0, 0);
+        return;
+    }
+    scheduler_.consume();
+    ++sequence_;
+}
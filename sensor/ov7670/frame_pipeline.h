@@ -0,0 +1,103 @@
+#ifndef FRAME_PIPELINE_H_
+#define FRAME_PIPELINE_H_
+
+#include <pico/stdlib.h>
+#include "frame_format.h"
+#include "pio_capture.h"
+#include "capture_scheduler.h"
+#include "frame_store.h"
+
+/*
+dual core frame pipeline
+core1 owns the capture engine and fills the slots of the frame store with the frames the scheduler asks for,
+core0 converts and transmits a previous frame at the same time.
+core1 is event driven: the VSYNC interrupt arms the capture, the DMA interrupt hands the frame off
+and arms the next one while the sensor is still in vertical blanking, core1 sleeps in between.
+during a capture core1 wakes up every HISTOGRAM_NAP_US to count the new bytes into the luma histogram of the frame.
+
+frames are handed off through the frame store (frame_store.h), core0 leases them in sequence order,
+other readers may lease the latest one, one by sequence or the ones since a time.
+a reader slower than the sensor loses the oldest frames, it never holds the capture back
+*/
+
+const uint32_t FRAME_TIMEOUT_US = 500000;   // 2 fps at least
+const uint32_t HISTOGRAM_NAP_US = 200;      // about a fifth of a 80x60 line
+const size_t HISTOGRAM_CHUNK_BYTES = 256;   // counted with interrupts masked, bounds the interrupt latency
+
+
+class frame_pipeline
+{
+public:
+    frame_pipeline(pio_capture& camera, capture_scheduler& scheduler);
+    ~frame_pipeline();
+
+public:
+    void start();       // launch capture loop on core1
+
+    /*
+    core0 only, wait for the oldest complete frame newer than the last one acquired
+    @return false if timeout
+    */
+    bool acquire_frame(frame_info& frame, uint32_t timeout_us = FRAME_TIMEOUT_US);
+    void release_frame(const frame_info& frame);    // end the lease, the slot can be captured into
+
+    // latest, by sequence and since a time queries, any core
+    frame_store& get_store() { return store_; }
+
+    /*
+    pixels per line and lines of the frames armed from now on, FRAME_PIXEL_BYTES per pixel, the region of interest
+    @return false if it doesn't fit in a frame buffer
+    */
+    bool set_frame_size(uint width, uint height);
+    void set_pixel_format(pixel_format format);     // sensor format of the frames armed from now on, for the histogram
+
+    // statistics
+    uint32_t get_captured_frames() const { return captured_frames_; }
+    uint32_t get_dropped_frames() const { return dropped_frames_; }         // wanted sensor frames missed by the capture
+    uint32_t get_capture_errors() const { return capture_errors_; }         // captures aborted, not complete in time
+    uint32_t get_buffer_starvation() const { return buffer_starvation_; }   // core1 had no free slot, every one is leased
+    uint32_t get_consumer_waits() const { return consumer_waits_; }         // core0 found no new frame
+    uint32_t get_overwritten() const { return store_.get_overwritten(); }   // complete frames nobody has read
+
+private:
+    static void core1_entry();
+    void capture_loop();
+
+    // core1 interrupt context
+    static void vsync_callback(void* user_data);
+    static void frame_callback(uint8_t* buf, size_t len, void* user_data);
+    void on_vsync();
+    void on_frame_captured();
+    void try_arm();
+    void update_histogram();    // core1 thread, count the bytes of the current frame already in memory
+
+private:
+    pio_capture& camera_;
+    capture_scheduler& scheduler_;
+    frame_store store_;
+
+    // core1 only
+    uint32_t sequence_ = 0;
+    int armed_slot_ = -1;
+    uint32_t armed_vsync_ = 0;
+    uint32_t starved_frame_ = 0;
+    uint32_t armed_geometry_ = 0;
+    luma_histogram histogram_;
+
+    volatile uint32_t geometry_ = (FRAME_WIDTH << 16) | FRAME_HEIGHT;    // written by core0, width << 16 | height
+    volatile pixel_format format_ = OV7670_LUMA_ONLY ? pixel_format::Y8 : pixel_format::YUV422;   // written by core0
+
+    // written by core1 only
+    volatile uint32_t captured_frames_ = 0;
+    volatile uint32_t dropped_frames_ = 0;
+    volatile uint32_t buffer_starvation_ = 0;
+    volatile uint32_t capture_errors_ = 0;
+    // written by core0 only
+    volatile uint32_t consumer_waits_ = 0;
+    uint32_t acquired_sequence_ = 0;
+
+    static frame_pipeline* instance_;   // core1 entry can not carry user data
+};
+
+
+#endif
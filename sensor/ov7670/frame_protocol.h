@@ -0,0 +1,120 @@
+#ifndef FRAME_PROTOCOL_H_
+#define FRAME_PROTOCOL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+binary frame protocol, shared by the firmware and the PC side tools (host/)
+one frame = frame_header + payload, all fields little endian
+
+crc is CRC-32 (IEEE 802.3) of the header with crc = 0, followed by the payload,
+a receiver scans for the magic to find the next frame after a broken one
+*/
+
+const uint32_t FRAME_MAGIC = 0x3637564F;         // "OV76"
+const uint32_t FRAME_MAX_PAYLOAD = 640 * 480 * 2;
+
+enum class pixel_format : uint8_t
+{
+    Y8 = 1,         // luma only, 1 byte per pixel
+    YUV422 = 2,     // Y,U,Y,V, 2 bytes per pixel
+    RGB565 = 3,     // RRRRRGGG,GGGBBBBB, 2 bytes per pixel
+};
+
+enum class frame_encoding : uint8_t
+{
+    RAW = 0,
+    DELTA_RLE = 1,  // changed tiles against the previous frame, see delta_codec.h
+    QOI = 2,        // lossless, 2 bytes per pixel formats only, see qoi_codec.h
+    BLOBS = 3,      // no pixels, blob_record list of the frame, format is Y8
+    MOTION = 4,     // no pixels, one motion_record, sent only when the frame has motion, format is Y8
+};
+
+struct frame_header
+{
+    uint32_t magic;
+    uint32_t sequence;          // gaps mean dropped frames
+    uint32_t capture_us;        // VSYNC timestamp, device clock
+    uint32_t send_us;           // header sent, device clock
+    uint16_t width;
+    uint16_t height;
+    uint8_t format;             // pixel_format
+    uint8_t encoding;           // frame_encoding
+    uint16_t reserved;
+    uint32_t payload_len;
+    uint32_t crc;
+};
+
+static_assert(sizeof(frame_header) == 32, "frame_header is sent as it is");
+
+// BLOBS payload, one record per bright blob, largest first, see vision_kernels.h
+struct blob_record
+{
+    uint16_t x0, y0;            // bounding box, inclusive
+    uint16_t x1, y1;
+    uint16_t centroid_x16;      // 1/16 pixel
+    uint16_t centroid_y16;
+    uint32_t area;              // pixels
+};
+
+static_assert(sizeof(blob_record) == 16, "blob_record is sent as it is");
+
+// MOTION payload, the moving blocks of the frame against the background, see motion_detector.h
+struct motion_record
+{
+    uint16_t x0, y0;            // bounding box of the moving blocks, inclusive
+    uint16_t x1, y1;
+    uint16_t blocks;            // moving blocks
+    uint16_t grid_blocks;       // blocks of the frame
+    uint8_t peak;               // largest difference of a moving block, luma
+    uint8_t mean;               // mean difference of the moving blocks, luma
+    int8_t light;               // luma change of the whole scene, taken out before the comparison
+    uint8_t reserved;
+};
+
+static_assert(sizeof(motion_record) == 16, "motion_record is sent as it is");
+
+
+// CRC-32 lookup table, reflected polynomial 0xEDB88320
+struct crc32_table
+{
+    uint32_t entry[256];
+
+    constexpr crc32_table() : entry()
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+            {
+                c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            }
+            entry[i] = c;
+        }
+    }
+};
+
+inline constexpr crc32_table CRC32_TABLE{};
+
+// start with crc = 0, feed the data piece by piece
+inline uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t len)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc = CRC32_TABLE.entry[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+inline uint32_t frame_crc(const frame_header& header, const uint8_t* payload)
+{
+    frame_header h = header;
+    h.crc = 0;
+    uint32_t crc = crc32_update(0, reinterpret_cast<const uint8_t*>(&h), sizeof(h));
+    return crc32_update(crc, payload, h.payload_len);
+}
+
+
+#endif
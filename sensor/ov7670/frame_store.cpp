@@ -0,0 +1,193 @@
+#include "frame_store.h"
+
+frame_store::frame_store()
+{
+    critical_section_init(&lock_);
+}
+
+int frame_store::begin_write(uint32_t sequence, uint16_t width, uint16_t height)
+{
+    critical_section_enter_blocking(&lock_);
+
+    // an empty or aborted slot first, then the oldest complete frame
+    int best = -1;
+    for (uint i = 0; i < FRAME_STORE_SLOTS; i++)
+    {
+        const slot& s = slots_[i];
+        if (s.leases || s.status == frame_status::CAPTURING)
+        {
+            continue;
+        }
+        if (s.status != frame_status::COMPLETE)
+        {
+            best = i;
+            break;
+        }
+        if (best < 0 || int32_t(s.sequence - slots_[best].sequence) < 0)
+        {
+            best = i;
+        }
+    }
+
+    if (best >= 0)
+    {
+        slot& s = slots_[best];
+        if (s.status == frame_status::COMPLETE && !s.leased_once)
+        {
+            ++overwritten_;
+        }
+        s.status = frame_status::CAPTURING;
+        s.sequence = sequence;
+        s.width = width;
+        s.height = height;
+        s.lines = 0;
+        s.leased_once = false;
+    }
+
+    critical_section_exit(&lock_);
+    return best;
+}
+
+void frame_store::end_write(uint slot, frame_status status, uint32_t capture_us, uint16_t lines)
+{
+    critical_section_enter_blocking(&lock_);
+    slots_[slot].capture_us = capture_us;
+    slots_[slot].lines = lines;
+    slots_[slot].status = status;
+    critical_section_exit(&lock_);
+
+    // readers waiting in __wfe on the other core
+    __sev();
+}
+
+bool frame_store::lease_latest(frame_info& frame)
+{
+    critical_section_enter_blocking(&lock_);
+    int best = -1;
+    for (uint i = 0; i < FRAME_STORE_SLOTS; i++)
+    {
+        if (slots_[i].status == frame_status::COMPLETE &&
+            (best < 0 || int32_t(slots_[i].sequence - slots_[best].sequence) > 0))
+        {
+            best = i;
+        }
+    }
+    if (best >= 0)
+    {
+        fill(best, frame);
+    }
+    critical_section_exit(&lock_);
+    return best >= 0;
+}
+
+bool frame_store::lease_next(uint32_t after_sequence, frame_info& frame)
+{
+    critical_section_enter_blocking(&lock_);
+    int best = -1;
+    for (uint i = 0; i < FRAME_STORE_SLOTS; i++)
+    {
+        if (slots_[i].status == frame_status::COMPLETE && int32_t(slots_[i].sequence - after_sequence) > 0 &&
+            (best < 0 || int32_t(slots_[i].sequence - slots_[best].sequence) < 0))
+        {
+            best = i;
+        }
+    }
+    if (best >= 0)
+    {
+        fill(best, frame);
+    }
+    critical_section_exit(&lock_);
+    return best >= 0;
+}
+
+bool frame_store::lease_sequence(uint32_t sequence, frame_info& frame)
+{
+    critical_section_enter_blocking(&lock_);
+    int found = -1;
+    for (uint i = 0; i < FRAME_STORE_SLOTS; i++)
+    {
+        const slot& s = slots_[i];
+        if (s.sequence == sequence && (s.status == frame_status::COMPLETE || s.status == frame_status::ABORTED))
+        {
+            found = i;
+            break;
+        }
+    }
+    if (found >= 0)
+    {
+        fill(found, frame);
+    }
+    critical_section_exit(&lock_);
+    return found >= 0;
+}
+
+size_t frame_store::lease_since(uint32_t since_us, frame_info* frames, size_t max)
+{
+    critical_section_enter_blocking(&lock_);
+
+    // at most FRAME_STORE_SLOTS candidates, insertion sort by sequence
+    uint order[FRAME_STORE_SLOTS];
+    size_t count = 0;
+    for (uint i = 0; i < FRAME_STORE_SLOTS; i++)
+    {
+        const slot& s = slots_[i];
+        if (s.status != frame_status::COMPLETE || int32_t(s.capture_us - since_us) < 0)
+        {
+            continue;
+        }
+        size_t j = count++;
+        for (; j > 0 && int32_t(slots_[order[j - 1]].sequence - s.sequence) > 0; j--)
+        {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+
+    count = count < max ? count : max;
+    for (size_t i = 0; i < count; i++)
+    {
+        fill(order[i], frames[i]);
+    }
+    critical_section_exit(&lock_);
+    return count;
+}
+
+void frame_store::release(const frame_info& frame)
+{
+    critical_section_enter_blocking(&lock_);
+    if (frame.index < FRAME_STORE_SLOTS && slots_[frame.index].leases)
+    {
+        --slots_[frame.index].leases;
+    }
+    critical_section_exit(&lock_);
+}
+
+uint32_t frame_store::get_leases() const
+{
+    critical_section_enter_blocking(&lock_);
+    uint32_t leases = 0;
+    for (const slot& s : slots_)
+    {
+        leases += s.leases;
+    }
+    critical_section_exit(&lock_);
+    return leases;
+}
+
+void frame_store::fill(uint index, frame_info& frame)
+{
+    slot& s = slots_[index];
+    ++s.leases;
+    s.leased_once = true;
+
+    frame.data = s.data;
+    frame.len = size_t(s.width) * s.height * FRAME_PIXEL_BYTES;
+    frame.sequence = s.sequence;
+    frame.capture_us = s.capture_us;
+    frame.width = s.width;
+    frame.height = s.height;
+    frame.lines = s.lines;
+    frame.status = s.status;
+    frame.stats = &s.stats;
+    frame.index = index;
+}
@@ -0,0 +1,110 @@
+#ifndef FRAME_STORE_H_
+#define FRAME_STORE_H_
+
+#include <pico/stdlib.h>
+#include <pico/sync.h>
+#include "frame_format.h"
+#include "luma_stats.h"
+
+/*
+timestamped frame store, FRAME_STORE_SLOTS frame buffers in a fixed memory budget
+every slot carries the sequence number, the VSYNC timestamp, the capture status and the lines in memory.
+
+one writer, the capture core, takes the oldest slot nobody reads, so a slow reader never blocks the capture,
+it only loses old frames, the sequence gaps tell how many.
+readers take zero copy leases on complete frames: latest, by sequence, next after a sequence, since a time.
+a leased slot is never written, so a reader never sees a torn frame. every lease must be released.
+
+the slot table is guarded by a critical section, readers and the writer may run on any core or in interrupts,
+no pixel is copied inside it
+*/
+
+const uint FRAME_STORE_SLOTS = 4;  // one being captured, one being read, two for history
+
+enum class frame_status : uint8_t
+{
+    EMPTY,          // never written
+    CAPTURING,      // the writer owns it
+    COMPLETE,       // every line in memory
+    ABORTED,        // capture stopped, lines tells what is in memory
+};
+
+struct frame_info
+{
+    const uint8_t* data = nullptr;
+    size_t len = 0;
+    uint32_t sequence = 0;      // counted by the writer, gaps mean dropped frames
+    uint32_t capture_us = 0;    // VSYNC timestamp
+    uint16_t width = 0;         // region of interest the frame was captured with
+    uint16_t height = 0;
+    uint16_t lines = 0;         // lines in memory, height when complete
+    frame_status status = frame_status::EMPTY;
+    const luma_stats* stats = nullptr;  // luma histogram, mean, min and max, valid until the lease is released
+    uint8_t index = 0;          // slot index, used to release the lease
+};
+
+
+class frame_store
+{
+public:
+    frame_store();
+
+public:
+    /*
+    writer, take the oldest slot without readers for the frame of sequence
+    @return slot index, -1 if every slot is leased
+    */
+    int begin_write(uint32_t sequence, uint16_t width, uint16_t height);
+    uint8_t* get_data(uint slot) { return slots_[slot].data; }
+    luma_stats* get_stats(uint slot) { return &slots_[slot].stats; }
+
+    /*
+    writer, publish the slot
+    @param status COMPLETE or ABORTED, EMPTY gives the slot back unused
+    @param capture_us VSYNC timestamp
+    @param lines lines in memory
+    */
+    void end_write(uint slot, frame_status status, uint32_t capture_us, uint16_t lines);
+
+    // readers, false if there is no such complete frame
+    bool lease_latest(frame_info& frame);
+    bool lease_next(uint32_t after_sequence, frame_info& frame);    // oldest complete frame newer than after_sequence
+    bool lease_sequence(uint32_t sequence, frame_info& frame);      // complete or aborted, see frame.status
+
+    /*
+    readers, complete frames captured at since_us or later, oldest first
+    @return frames leased, max at most
+    */
+    size_t lease_since(uint32_t since_us, frame_info* frames, size_t max);
+
+    void release(const frame_info& frame);
+
+    // statistics
+    uint32_t get_overwritten() const { return overwritten_; }   // complete frames reused before anyone leased them
+    uint32_t get_leases() const;                                // leases held now
+
+private:
+    struct slot
+    {
+        alignas(4) uint8_t data[FRAME_BYTES];
+        luma_stats stats;
+        uint32_t sequence = 0;
+        uint32_t capture_us = 0;
+        uint16_t width = 0;
+        uint16_t height = 0;
+        uint16_t lines = 0;
+        frame_status status = frame_status::EMPTY;
+        bool leased_once = false;
+        uint8_t leases = 0;
+    };
+
+    void fill(uint index, frame_info& frame);     // lock held
+
+private:
+    slot slots_[FRAME_STORE_SLOTS];
+    mutable critical_section_t lock_;
+    volatile uint32_t overwritten_ = 0;
+};
+
+
+#endif
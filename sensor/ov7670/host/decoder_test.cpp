@@ -0,0 +1,382 @@
+/*
+PC side test of the frame decoder (frame_decoder.h) on the recorded byte streams in streams/, no hardware needed
+every stream is fed in one piece and again in pieces of 1 to 13 bytes, the decoded frames,
+their pixels and the decoder counters must match what the stream was made of.
+
+    clean.bin       one frame of every format and encoding: RAW Y8, RAW YUV422, delta keyframe + delta, QOI, BLOBS, MOTION
+    garbage.bin     noise, a partial magic and a magic with a broken header between frames, a delta frame after the noise
+    crc.bin         a frame with a flipped payload byte, a frame with a flipped header byte
+    gaps.bin        sequence numbers 0, 1, 4, 5, 9
+    truncated.bin   a frame cut short by the next one, a RAW frame shorter than its plane, the last frame cut by the end
+    luma565.bin     luma frames converted to RGB565 like the luma-only build sends them, RAW and QOI
+
+build: g++ -O2 -std=c++17 -o decoder_test decoder_test.cpp ../delta_codec.cpp ../qoi_codec.cpp
+usage:
+    decoder_test streams            check the streams, exit 1 on a failure
+    decoder_test -g streams         write the streams again, after a protocol change
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "frame_decoder.h"
+#include "../pixel_convert.h"
+
+const uint16_t TEST_WIDTH = 16;
+const uint16_t TEST_HEIGHT = 12;
+
+typedef std::vector<uint8_t> byte_stream;
+
+
+// pixels of frame sequence, every frame differs from the one before
+static uint8_t test_luma(size_t i, uint32_t sequence)
+{
+    return uint8_t((i % TEST_WIDTH) * 5 + (i / TEST_WIDTH) * 3 + sequence * 11);
+}
+
+static std::vector<uint8_t> test_pixels(pixel_format format, uint32_t sequence)
+{
+    const size_t pixels = size_t(TEST_WIDTH) * TEST_HEIGHT;
+    std::vector<uint8_t> out;
+    if (format == pixel_format::RGB565)
+    {
+        // the luma-only build converts its Y8 capture, the kernel of the firmware
+        std::vector<uint8_t> luma = test_pixels(pixel_format::Y8, sequence);
+        out.resize(pixels * 2);
+        y8_to_rgb565(luma.data(), out.data(), pixels);
+        return out;
+    }
+    for (size_t i = 0; i < pixels; i++)
+    {
+        out.push_back(test_luma(i, sequence));
+        if (format != pixel_format::Y8)
+        {
+            out.push_back(uint8_t(i & 1 ? 128 - sequence : 128 + sequence));     // U, V
+        }
+    }
+    return out;
+}
+
+static std::vector<uint8_t> test_blobs()
+{
+    blob_record blobs[2] = {{1, 2, 5, 6, 3 * 16, 4 * 16, 25}, {8, 0, 15, 3, 11 * 16, 1 * 16, 32}};
+    return std::vector<uint8_t>(reinterpret_cast<uint8_t*>(blobs), reinterpret_cast<uint8_t*>(blobs) + sizeof(blobs));
+}
+
+static std::vector<uint8_t> test_motion()
+{
+    motion_record event = {0, 0, 7, 7, 1, 4, 40, 20, -2, 0};
+    return std::vector<uint8_t>(reinterpret_cast<uint8_t*>(&event), reinterpret_cast<uint8_t*>(&event) + sizeof(event));
+}
+
+static frame_header make_header(uint32_t sequence, pixel_format format, frame_encoding encoding, const std::vector<uint8_t>& payload)
+{
+    frame_header h = {};
+    h.magic = FRAME_MAGIC;
+    h.sequence = sequence;
+    h.capture_us = sequence * 83333;
+    h.send_us = h.capture_us + 3000;
+    h.width = TEST_WIDTH;
+    h.height = TEST_HEIGHT;
+    h.format = uint8_t(format);
+    h.encoding = uint8_t(encoding);
+    h.payload_len = uint32_t(payload.size());
+    h.crc = frame_crc(h, payload.data());
+    return h;
+}
+
+static void append(byte_stream& s, const frame_header& h, const std::vector<uint8_t>& payload, size_t payload_len)
+{
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(&h);
+    s.insert(s.end(), p, p + sizeof(h));
+    s.insert(s.end(), payload.begin(), payload.begin() + payload_len);
+}
+
+static void append_frame(byte_stream& s, uint32_t sequence, pixel_format format, frame_encoding encoding,
+                         const std::vector<uint8_t>& payload)
+{
+    append(s, make_header(sequence, format, encoding, payload), payload, payload.size());
+}
+
+static void append_raw(byte_stream& s, uint32_t sequence, pixel_format format = pixel_format::Y8)
+{
+    append_frame(s, sequence, format, frame_encoding::RAW, test_pixels(format, sequence));
+}
+
+// luma delta frames of one stream, the encoder keeps the reference like the firmware does
+struct delta_source
+{
+    std::vector<uint8_t> ref = std::vector<uint8_t>(size_t(TEST_WIDTH) * TEST_HEIGHT);
+
+    void append(byte_stream& s, uint32_t sequence, bool keyframe)
+    {
+        std::vector<uint8_t> out(delta_max_encoded_size(TEST_WIDTH, TEST_HEIGHT));
+        std::vector<uint8_t> cur = test_pixels(pixel_format::Y8, sequence);
+        out.resize(delta_encode(cur.data(), ref.data(), TEST_WIDTH, TEST_HEIGHT, keyframe, 0, out.data()));
+        append_frame(s, sequence, pixel_format::Y8, frame_encoding::DELTA_RLE, out);
+    }
+};
+
+static void append_noise(byte_stream& s, size_t len, uint8_t seed)
+{
+    // no 'O', the noise never holds a magic
+    for (size_t i = 0; i < len; i++)
+    {
+        uint8_t b = uint8_t(seed + i * 37);
+        s.push_back(b == 'O' ? 0 : b);
+    }
+}
+
+
+static byte_stream make_clean()
+{
+    byte_stream s;
+    delta_source delta;
+    append_raw(s, 0, pixel_format::Y8);
+    append_raw(s, 1, pixel_format::YUV422);
+    delta.append(s, 2, true);
+    delta.append(s, 3, false);
+
+    std::vector<uint8_t> pixels = test_pixels(pixel_format::YUV422, 4);
+    std::vector<uint8_t> qoi(qoi_max_encoded_size(pixels.size()));
+    qoi.resize(qoi_encode(pixels.data(), size_t(TEST_WIDTH) * 2, TEST_HEIGHT, qoi.data()));
+    append_frame(s, 4, pixel_format::YUV422, frame_encoding::QOI, qoi);
+
+    append_frame(s, 5, pixel_format::Y8, frame_encoding::BLOBS, test_blobs());
+    append_frame(s, 6, pixel_format::Y8, frame_encoding::MOTION, test_motion());
+    return s;
+}
+
+static byte_stream make_luma565()
+{
+    byte_stream s;
+    append_raw(s, 0, pixel_format::RGB565);
+
+    std::vector<uint8_t> pixels = test_pixels(pixel_format::RGB565, 1);
+    std::vector<uint8_t> qoi(qoi_max_encoded_size(pixels.size()));
+    qoi.resize(qoi_encode(pixels.data(), size_t(TEST_WIDTH) * 2, TEST_HEIGHT, qoi.data()));
+    append_frame(s, 1, pixel_format::RGB565, frame_encoding::QOI, qoi);
+
+    // half the plane, what the luma-only build sent before the length was fixed
+    pixels = test_pixels(pixel_format::RGB565, 2);
+    pixels.resize(pixels.size() / 2);
+    append_frame(s, 2, pixel_format::RGB565, frame_encoding::RAW, pixels);
+    append_raw(s, 3, pixel_format::RGB565);
+    return s;
+}
+
+static byte_stream make_garbage()
+{
+    byte_stream s;
+    delta_source delta;
+    append_noise(s, 37, 1);
+    delta.append(s, 0, true);
+    s.insert(s.end(), {'O', 'V', '7'});
+    append_noise(s, 20, 2);
+    delta.append(s, 1, false);      // a frame may have been lost in the noise, no reference
+
+    // a magic followed by a header that makes no sense
+    frame_header broken = make_header(2, pixel_format::Y8, frame_encoding::RAW, {});
+    broken.format = 9;
+    append(s, broken, {}, 0);
+    append_noise(s, 5, 3);
+
+    delta.append(s, 2, true);
+    delta.append(s, 3, false);
+    return s;
+}
+
+static byte_stream make_crc()
+{
+    byte_stream s;
+    append_raw(s, 0);
+    size_t start = s.size();
+    append_raw(s, 1);
+    s[start + sizeof(frame_header) + 10] ^= 0x10;
+    start = s.size();
+    append_raw(s, 2);
+    s[start + offsetof(frame_header, send_us)] ^= 0x01;
+    append_raw(s, 3);
+    return s;
+}
+
+static byte_stream make_gaps()
+{
+    byte_stream s;
+    for (uint32_t sequence : {0, 1, 4, 5, 9})
+    {
+        append_raw(s, sequence);
+    }
+    return s;
+}
+
+static byte_stream make_truncated()
+{
+    byte_stream s;
+    append_raw(s, 0);
+
+    // half the payload, then the next frame
+    std::vector<uint8_t> pixels = test_pixels(pixel_format::Y8, 1);
+    append(s, make_header(1, pixel_format::Y8, frame_encoding::RAW, pixels), pixels, pixels.size() / 2);
+    append_raw(s, 2);
+
+    // a RAW frame with a valid crc but less than its plane
+    pixels = test_pixels(pixel_format::Y8, 3);
+    pixels.resize(pixels.size() - 16);
+    append_frame(s, 3, pixel_format::Y8, frame_encoding::RAW, pixels);
+    append_raw(s, 4);
+
+    // the stream ends in the middle of the last frame
+    pixels = test_pixels(pixel_format::Y8, 5);
+    append(s, make_header(5, pixel_format::Y8, frame_encoding::RAW, pixels), pixels, 40);
+    return s;
+}
+
+
+struct stream_case
+{
+    const char* name;
+    byte_stream (*make)();
+    std::vector<uint32_t> sequences;        // decoded frames
+    decoder_stats expected;                 // frames, dropped, crc errors, bad headers, skipped bytes, undecodable
+};
+
+static const stream_case stream_cases[] =
+{
+    {"clean.bin", make_clean, {0, 1, 2, 3, 4, 5, 6}, {7, 0, 0, 0, 0, 0}},
+    {"garbage.bin", make_garbage, {0, 2, 3}, {4, 0, 0, 1, 37 + 3 + 20 + sizeof(frame_header) + 5, 1}},
+    {"crc.bin", make_crc, {0, 3}, {2, 2, 2, 0, 2 * (sizeof(frame_header) + TEST_WIDTH * TEST_HEIGHT), 0}},
+    {"gaps.bin", make_gaps, {0, 1, 4, 5, 9}, {5, 5, 0, 0, 0, 0}},
+    {"truncated.bin", make_truncated, {0, 2, 4}, {3, 2, 1, 1, sizeof(frame_header) + TEST_WIDTH * TEST_HEIGHT / 2 +
+                                                              sizeof(frame_header) + TEST_WIDTH * TEST_HEIGHT - 16, 0}},
+    {"luma565.bin", make_luma565, {0, 1, 3}, {3, 1, 0, 1, sizeof(frame_header) + TEST_WIDTH * TEST_HEIGHT, 0}},
+};
+
+
+static bool read_file(const std::string& path, byte_stream& s)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp)
+    {
+        perror(path.c_str());
+        return false;
+    }
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+        s.insert(s.end(), buf, buf + n);
+    }
+    fclose(fp);
+    return true;
+}
+
+static bool write_file(const std::string& path, const byte_stream& s)
+{
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp || fwrite(s.data(), 1, s.size(), fp) != s.size())
+    {
+        perror(path.c_str());
+        return false;
+    }
+    fclose(fp);
+    return true;
+}
+
+// the payload a frame must decode to
+static std::vector<uint8_t> expected_payload(const frame_header& h)
+{
+    if (h.encoding == uint8_t(frame_encoding::BLOBS))
+        return test_blobs();
+    if (h.encoding == uint8_t(frame_encoding::MOTION))
+        return test_motion();
+    return test_pixels(pixel_format(h.format), h.sequence);
+}
+
+static bool check_stats(const char* what, const decoder_stats& got, const decoder_stats& expected)
+{
+    bool ok = got.frames == expected.frames && got.dropped == expected.dropped && got.crc_errors == expected.crc_errors &&
+              got.bad_headers == expected.bad_headers && got.skipped_bytes == expected.skipped_bytes &&
+              got.undecodable == expected.undecodable;
+    if (!ok)
+    {
+        printf("  %s: frames %d, dropped %d, crc errors %d, bad headers %d, skipped bytes %d, undecodable %d\n"
+               "  expected: frames %d, dropped %d, crc errors %d, bad headers %d, skipped bytes %d, undecodable %d\n",
+               what, int(got.frames), int(got.dropped), int(got.crc_errors), int(got.bad_headers), int(got.skipped_bytes),
+               int(got.undecodable), int(expected.frames), int(expected.dropped), int(expected.crc_errors),
+               int(expected.bad_headers), int(expected.skipped_bytes), int(expected.undecodable));
+    }
+    return ok;
+}
+
+// feed in pieces of chunk bytes, 0 cycles through 1..13
+static bool run_case(const stream_case& c, const byte_stream& s, size_t chunk)
+{
+    char what[32];
+    snprintf(what, sizeof(what), chunk ? "whole stream" : "1..13 byte pieces");
+    frame_decoder decoder;
+    decoded_frame f;
+    std::vector<uint32_t> sequences;
+    size_t broken = 0;
+    for (size_t pos = 0, piece = 1; pos < s.size(); piece = piece % 13 + 1)
+    {
+        size_t n = chunk ? chunk : piece;
+        n = n < s.size() - pos ? n : s.size() - pos;
+        decoder.feed(&s[pos], n);
+        pos += n;
+        while (decoder.next_frame(f))
+        {
+            sequences.push_back(f.header.sequence);
+            broken += f.payload != expected_payload(f.header);
+        }
+    }
+
+    bool ok = check_stats(what, decoder.get_stats(), c.expected);
+    if (sequences != c.sequences || broken)
+    {
+        printf("  %s: %d frames decoded, %d with wrong pixels, sequences:", what, int(sequences.size()), int(broken));
+        for (uint32_t sequence : sequences)
+        {
+            printf(" %d", int(sequence));
+        }
+        printf("\n");
+        ok = false;
+    }
+    return ok;
+}
+
+
+int main(int argc, char** argv)
+{
+    bool generate = argc == 3 && strcmp(argv[1], "-g") == 0;
+    if (argc != 2 && !generate)
+    {
+        printf("usage: %s [-g] streams_dir\n", argv[0]);
+        return 2;
+    }
+    std::string dir = argv[argc - 1];
+
+    int failed = 0;
+    for (auto& c : stream_cases)
+    {
+        std::string path = dir + "/" + c.name;
+        if (generate)
+        {
+            failed += !write_file(path, c.make());
+            continue;
+        }
+
+        byte_stream s;
+        if (!read_file(path, s))
+        {
+            ++failed;
+            continue;
+        }
+        bool ok = run_case(c, s, s.size()) & run_case(c, s, 0);
+        printf("%-14s %6d bytes  %s\n", c.name, int(s.size()), ok ? "ok" : "FAILED");
+        failed += !ok;
+    }
+    return failed ? 1 : 0;
+}
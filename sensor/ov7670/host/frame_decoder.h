@@ -0,0 +1,209 @@
+#ifndef FRAME_DECODER_H_
+#define FRAME_DECODER_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "../frame_protocol.h"
+#include "../delta_codec.h"
+#include "../qoi_codec.h"
+
+/*
+PC side decoder of the binary frame protocol
+feed it the raw bytes read from the COM port (or a recorded stream), take the verified frames out.
+a broken frame is skipped by scanning for the next magic, sequence gaps are counted as dropped frames.
+delta frames are decoded against the previous frame, after a broken frame they are dropped until the next keyframe
+*/
+
+struct decoded_frame
+{
+    frame_header header;
+    std::vector<uint8_t> payload;   // raw pixels whatever the encoding, blob_record list for BLOBS, motion_record for MOTION
+    size_t encoded_len = 0;         // payload bytes on the link
+};
+
+struct decoder_stats
+{
+    uint64_t frames = 0;
+    uint64_t dropped = 0;           // sequence gaps
+    uint64_t crc_errors = 0;
+    uint64_t bad_headers = 0;       // magic found but the header makes no sense
+    uint64_t skipped_bytes = 0;     // bytes thrown away while looking for a frame
+    uint64_t undecodable = 0;       // delta frames without a valid reference, waiting for a keyframe
+};
+
+
+class frame_decoder
+{
+public:
+    void feed(const uint8_t* data, size_t len)
+    {
+        buf_.insert(buf_.end(), data, data + len);
+    }
+
+    /*
+    take the next verified frame
+    @return false if more bytes are needed
+    */
+    bool next_frame(decoded_frame& frame)
+    {
+        while (true)
+        {
+            if (!find_magic())
+            {
+                compact();
+                return false;
+            }
+
+            size_t avail = buf_.size() - pos_;
+            if (avail < sizeof(frame_header))
+            {
+                compact();
+                return false;
+            }
+
+            frame_header header;
+            memcpy(&header, &buf_[pos_], sizeof(header));
+            if (!is_header_valid(header))
+            {
+                ++stats_.bad_headers;
+                skip(1);
+                continue;
+            }
+
+            if (avail < sizeof(frame_header) + header.payload_len)
+            {
+                compact();
+                return false;
+            }
+
+            const uint8_t* payload = &buf_[pos_ + sizeof(frame_header)];
+            if (frame_crc(header, payload) != header.crc)
+            {
+                ++stats_.crc_errors;
+                skip(1);
+                continue;
+            }
+
+            // a frame may be lost in the skipped bytes, the delta chain is broken
+            if (stats_.skipped_bytes != skipped_at_last_frame_)
+            {
+                reference_valid_ = false;
+            }
+            pos_ += sizeof(frame_header) + header.payload_len;
+            skipped_at_last_frame_ = stats_.skipped_bytes;
+
+            if (has_sequence_ && header.sequence > last_sequence_ + 1)
+            {
+                stats_.dropped += header.sequence - last_sequence_ - 1;
+            }
+            last_sequence_ = header.sequence;
+            has_sequence_ = true;
+            ++stats_.frames;
+
+            frame.header = header;
+            frame.encoded_len = header.payload_len;
+            if (!decode_payload(header, payload, frame.payload))
+            {
+                ++stats_.undecodable;
+                continue;
+            }
+            return true;
+        }
+    }
+
+    const decoder_stats& get_stats() const { return stats_; }
+
+private:
+    bool decode_payload(const frame_header& h, const uint8_t* payload, std::vector<uint8_t>& out)
+    {
+        if (h.encoding == uint8_t(frame_encoding::RAW) || h.encoding == uint8_t(frame_encoding::BLOBS) ||
+            h.encoding == uint8_t(frame_encoding::MOTION))
+        {
+            out.assign(payload, payload + h.payload_len);
+            return true;
+        }
+
+        if (h.encoding == uint8_t(frame_encoding::QOI))
+        {
+            out.resize(size_t(h.width) * h.height * 2);
+            return qoi_decode(payload, h.payload_len, out.data(), size_t(h.width) * 2, h.height);
+        }
+
+        // delta, the plane is width * bytes per pixel wide
+        size_t plane_width = size_t(h.width) * (h.format == uint8_t(pixel_format::Y8) ? 1 : 2);
+        bool keyframe = h.payload_len && (payload[0] & DELTA_FLAG_KEYFRAME);
+        if (!keyframe && !reference_valid_)
+        {
+            return false;
+        }
+
+        reference_.resize(plane_width * h.height);
+        reference_valid_ = delta_decode(payload, h.payload_len, reference_.data(), plane_width, h.height);
+        if (!reference_valid_)
+        {
+            return false;
+        }
+        out = reference_;
+        return true;
+    }
+
+    static bool is_header_valid(const frame_header& h)
+    {
+        // a raw frame is the whole plane, nothing more or less
+        size_t plane = size_t(h.width) * h.height * (h.format == uint8_t(pixel_format::Y8) ? 1 : 2);
+        return h.payload_len <= FRAME_MAX_PAYLOAD && h.width && h.height &&
+               (h.format == uint8_t(pixel_format::Y8) || h.format == uint8_t(pixel_format::YUV422) ||
+                h.format == uint8_t(pixel_format::RGB565)) &&
+               ((h.encoding == uint8_t(frame_encoding::RAW) && h.payload_len == plane) ||
+                h.encoding == uint8_t(frame_encoding::DELTA_RLE) ||
+                (h.encoding == uint8_t(frame_encoding::QOI) && h.format != uint8_t(pixel_format::Y8)) ||
+                (h.encoding == uint8_t(frame_encoding::BLOBS) && h.payload_len % sizeof(blob_record) == 0) ||
+                (h.encoding == uint8_t(frame_encoding::MOTION) && h.payload_len == sizeof(motion_record)));
+    }
+
+    // move pos_ to the next magic, keep the last 3 bytes which may be the beginning of it
+    bool find_magic()
+    {
+        const uint8_t magic[4] = {FRAME_MAGIC & 0xff, (FRAME_MAGIC >> 8) & 0xff, (FRAME_MAGIC >> 16) & 0xff, FRAME_MAGIC >> 24};
+        size_t start = pos_;
+        while (pos_ + 4 <= buf_.size())
+        {
+            if (memcmp(&buf_[pos_], magic, 4) == 0)
+            {
+                stats_.skipped_bytes += pos_ - start;
+                return true;
+            }
+            ++pos_;
+        }
+        stats_.skipped_bytes += pos_ - start;
+        return false;
+    }
+
+    void skip(size_t n)
+    {
+        pos_ += n;
+        stats_.skipped_bytes += n;
+    }
+
+    void compact()
+    {
+        buf_.erase(buf_.begin(), buf_.begin() + pos_);
+        pos_ = 0;
+    }
+
+private:
+    std::vector<uint8_t> buf_;
+    size_t pos_ = 0;
+    uint32_t last_sequence_ = 0;
+    bool has_sequence_ = false;
+    decoder_stats stats_;
+
+    // delta decoding
+    std::vector<uint8_t> reference_;
+    bool reference_valid_ = false;
+    uint64_t skipped_at_last_frame_ = 0;
+};
+
+
+#endif
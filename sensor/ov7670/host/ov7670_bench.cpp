@@ -0,0 +1,827 @@
+/*
+PC side benchmark of the ov7670 frame processing stages, run on recorded frames
+record a stream with: ov7670_viewer -d /dev/ttyACM0 -m y -r record.bin
+
+build: g++ -O2 -std=c++17 -o ov7670_bench ov7670_bench.cpp ../delta_codec.cpp ../qoi_codec.cpp ../luma_stats.cpp ../vision_kernels.cpp \
+      ../motion_detector.cpp ../luma_pyramid.cpp
+usage: ov7670_bench record.bin
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <tuple>
+#include <array>
+#include "frame_decoder.h"
+#include "../pixel_convert.h"
+#include "../luma_stats.h"
+#include "../vision_kernels.h"
+#include "../motion_detector.h"
+#include "../luma_pyramid.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+// 115200 baud, 8N1
+const double UART_BYTES_PER_SECOND = 11520.0;
+const size_t HISTOGRAM_BENCH_CHUNK = 256;  // HISTOGRAM_CHUNK_BYTES of frame_pipeline.h
+const size_t MOTION_BENCH_KEYFRAME = 120;   // frames, MOTION_KEYFRAME_MS of main.cpp at 12 fps
+
+struct luma_frame
+{
+    size_t width;
+    size_t height;
+    std::vector<uint8_t> y;
+    std::vector<uint8_t> pixels;    // 2 bytes per pixel as captured, YUV422 made of the luma for Y8 recordings
+    pixel_format format;            // of pixels, the recorded format, YUV422 for Y8 recordings
+};
+
+
+static std::vector<luma_frame> load_frames(const char* path)
+{
+    std::vector<luma_frame> frames;
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+    {
+        perror(path);
+        return frames;
+    }
+
+    frame_decoder decoder;
+    decoded_frame f;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+        decoder.feed(buf, n);
+        while (decoder.next_frame(f))
+        {
+            if (f.header.encoding == uint8_t(frame_encoding::BLOBS) || f.header.encoding == uint8_t(frame_encoding::MOTION))
+            {
+                continue;   // no pixels
+            }
+            luma_frame l{f.header.width, f.header.height, {}, {},
+                         f.header.format == uint8_t(pixel_format::Y8) ? pixel_format::YUV422 : pixel_format(f.header.format)};
+            l.y.resize(l.width * l.height);
+            if (f.header.format == uint8_t(pixel_format::RGB565))
+                rgb565_to_luma_ref(f.payload.data(), l.y.data(), l.y.size());
+            else if (f.header.format == uint8_t(pixel_format::YUV422))
+                yuv422_to_luma_ref(f.payload.data(), l.y.data(), l.y.size());
+            else
+                memcpy(l.y.data(), f.payload.data(), l.y.size());
+
+            if (f.header.format == uint8_t(pixel_format::Y8))
+            {
+                // neutral chroma
+                l.pixels.resize(l.y.size() * 2);
+                for (size_t i = 0; i < l.y.size(); i++)
+                {
+                    l.pixels[2 * i] = l.y[i];
+                    l.pixels[2 * i + 1] = 128;
+                }
+            }
+            else
+            {
+                l.pixels = f.payload;
+            }
+            frames.push_back(std::move(l));
+        }
+    }
+    fclose(fp);
+    return frames;
+}
+
+
+static double elapsed_us(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+// delta codec: compression ratio, encode time and error per threshold
+static void bench_delta(const std::vector<luma_frame>& frames)
+{
+    const size_t w = frames[0].width;
+    const size_t h = frames[0].height;
+    const double raw_bytes = sizeof(frame_header) + w * h;
+
+    printf("== delta codec, %zux%zu, keyframe every 30 frames\n", w, h);
+    for (uint8_t threshold : {0, 2, 4, 8, 16})
+    {
+        std::vector<uint8_t> ref(w * h), decoded(w * h), out(delta_max_encoded_size(w, h));
+        delta_encoder encoder{ref.data(), w, h, 30, threshold};
+        double total_bytes = 0;
+        double encode_us = 0;
+        int max_error = 0;
+        bool broken = false;
+
+        for (auto& f : frames)
+        {
+            if (f.width != w || f.height != h)
+            {
+                continue;
+            }
+            auto start = std::chrono::steady_clock::now();
+            size_t len = encoder.encode(f.y.data(), out.data());
+            encode_us += elapsed_us(start);
+            total_bytes += sizeof(frame_header) + len;
+
+            broken |= !delta_decode(out.data(), len, decoded.data(), w, h) || decoded != ref;
+            for (size_t i = 0; i < w * h; i++)
+            {
+                max_error = std::max(max_error, abs(int(decoded[i]) - int(f.y[i])));
+            }
+        }
+
+        double per_frame = total_bytes / frames.size();
+        printf("threshold %3d: %7.0f bytes/frame, ratio %5.2f, encode %6.1fus/frame, max error %3d, "
+               "115200bd %5.2f fps (raw %4.2f fps)%s\n",
+               threshold, per_frame, raw_bytes / per_frame, encode_us / frames.size(), max_error,
+               UART_BYTES_PER_SECOND / per_frame, UART_BYTES_PER_SECOND / raw_bytes, broken ? ", ROUND TRIP BROKEN" : "");
+    }
+}
+
+
+// pixel kernels: SWAR against the one pixel reference, same bytes expected
+// cycles are TSC ticks on x86, the pico reports core cycles of the same kernels at startup
+static void bench_pixel(size_t w, size_t h)
+{
+    typedef void (*kernel_t)(const uint8_t* src, uint8_t* dst, size_t pixels);
+    struct kernel_entry
+    {
+        const char* name;
+        kernel_t swar;
+        kernel_t ref;
+        size_t out_bytes_per_pixel;
+    };
+    const kernel_entry kernels[] = {
+        {"yuv422 -> luma", yuv422_to_luma, yuv422_to_luma_ref, 1},
+        {"rgb565 -> luma", rgb565_to_luma, rgb565_to_luma_ref, 1},
+        {"yuv422 -> rgb565", yuv422_to_rgb565, yuv422_to_rgb565_ref, 2},
+    };
+    const size_t pixels = w * h;
+    const int rounds = 2000;
+
+    // any bytes are a valid YUV422 or RGB565 frame
+    std::vector<uint32_t> src_words(pixels / 2), out_words(pixels / 2), ref_words(pixels / 2);
+    uint32_t seed = 1;
+    for (auto& word : src_words)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        word = seed;
+    }
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(src_words.data());
+    uint8_t* out = reinterpret_cast<uint8_t*>(out_words.data());
+    uint8_t* ref = reinterpret_cast<uint8_t*>(ref_words.data());
+
+    printf("== pixel kernels, %zux%zu, %d rounds\n", w, h, rounds);
+    for (auto& k : kernels)
+    {
+        double us[2];
+        double cycles[2] = {0, 0};
+        kernel_t fn[2] = {k.swar, k.ref};
+        for (int n = 0; n < 2; n++)
+        {
+            auto start = std::chrono::steady_clock::now();
+#ifdef HAVE_TSC
+            uint64_t tsc = __rdtsc();
+#endif
+            for (int r = 0; r < rounds; r++)
+            {
+                fn[n](src, n ? ref : out, pixels);
+                asm volatile("" ::: "memory");  // keep every round
+            }
+#ifdef HAVE_TSC
+            cycles[n] = double(__rdtsc() - tsc) / rounds / pixels;
+#endif
+            us[n] = elapsed_us(start) / rounds;
+        }
+
+        bool same = memcmp(out, ref, pixels * k.out_bytes_per_pixel) == 0;
+        printf("%-18s swar %7.2fus/frame %5.2f cycles/pixel, reference %7.2fus/frame %5.2f cycles/pixel, %4.1fx%s\n",
+               k.name, us[0], cycles[0], us[1], cycles[1], us[1] / us[0], same ? "" : ", MISMATCH");
+    }
+}
+
+
+// QOI codec: compression ratio, encode and decode time, bit exact round trip of every frame
+static bool bench_qoi(const std::vector<luma_frame>& frames)
+{
+    const size_t w = frames[0].width;
+    const size_t h = frames[0].height;
+    const double raw_bytes = sizeof(frame_header) + w * h * 2;
+
+    std::vector<uint8_t> out(qoi_max_encoded_size(w * h * 2)), decoded(w * h * 2);
+    double total_bytes = 0;
+    double encode_us = 0;
+    double decode_us = 0;
+    size_t count = 0;
+    size_t broken = 0;
+
+    for (auto& f : frames)
+    {
+        if (f.width != w || f.height != h)
+        {
+            continue;
+        }
+        auto start = std::chrono::steady_clock::now();
+        size_t len = qoi_encode(f.pixels.data(), w * 2, h, out.data());
+        encode_us += elapsed_us(start);
+
+        start = std::chrono::steady_clock::now();
+        bool ok = qoi_decode(out.data(), len, decoded.data(), w * 2, h);
+        decode_us += elapsed_us(start);
+
+        broken += !ok || decoded != f.pixels;
+        total_bytes += sizeof(frame_header) + std::min(len, w * h * 2);     // raw is sent when smaller
+        ++count;
+    }
+
+    double per_frame = total_bytes / count;
+    printf("== qoi codec, %zux%zu, 2 bytes per pixel\n", w, h);
+    printf("%7.0f bytes/frame, ratio %5.2f, encode %6.1fus/frame, decode %6.1fus/frame, "
+           "115200bd %5.2f fps (raw %4.2f fps), round trip %zu/%zu frames bit exact\n",
+           per_frame, raw_bytes / per_frame, encode_us / count, decode_us / count,
+           UART_BYTES_PER_SECOND / per_frame, UART_BYTES_PER_SECOND / raw_bytes, count - broken, count);
+    return broken == 0;
+}
+
+
+// luma histogram: fed in uneven pieces like core1 trailing the DMA, same bins as one pass expected.
+// ascii levels: charmap chars used per frame by each contrast mode, 71 at most
+static bool bench_histogram(const std::vector<luma_frame>& frames)
+{
+    const contrast_mode modes[] = {contrast_mode::LINEAR, contrast_mode::STRETCH, contrast_mode::EQUALIZE};
+    const char* names[] = {"linear", "stretch", "equalize"};
+    double levels[3] = {0, 0, 0};
+    double us = 0;
+    size_t pixels = 0;
+    size_t broken = 0;
+
+    luma_histogram histogram;
+    luma_stats stats;
+    luma_stats whole;
+    for (auto& f : frames)
+    {
+        size_t len = f.pixels.size();
+        auto start = std::chrono::steady_clock::now();
+        histogram.begin(f.pixels.data(), f.format, &stats);
+        for (size_t bytes = 0; bytes < len; bytes += 37)
+        {
+            histogram.feed(bytes, HISTOGRAM_BENCH_CHUNK);
+        }
+        histogram.finish(len);
+        us += elapsed_us(start);
+        pixels += len / 2;
+
+        histogram.begin(f.pixels.data(), f.format, &whole);
+        histogram.finish(len);
+        uint32_t sum = 0;
+        for (uint8_t y : f.y)
+        {
+            sum += y;
+        }
+        broken += memcmp(stats.bins, whole.bins, sizeof(stats.bins)) != 0 || stats.count != f.y.size() || stats.sum != sum ||
+                  stats.min != *std::min_element(f.y.begin(), f.y.end()) || stats.max != *std::max_element(f.y.begin(), f.y.end());
+
+        for (int m = 0; m < 3; m++)
+        {
+            uint8_t curve[256];
+            build_tone_curve(stats, modes[m], curve);
+            bool used[71] = {};
+            for (uint32_t y = 0; y < 256; y++)
+            {
+                used[70 - curve[y] * 10 / 37] |= stats.bins[y] != 0;
+            }
+            levels[m] += std::count(used, used + 71, true);
+        }
+    }
+
+    printf("== luma histogram, fed in pieces of 37 bytes\n");
+    printf("%.2fns/pixel, %zu/%zu frames match the one pass histogram\n", us * 1000 / pixels, frames.size() - broken, frames.size());
+    for (int m = 0; m < 3; m++)
+    {
+        printf("%-9s %5.1f ascii levels/frame\n", names[m], levels[m] / frames.size());
+    }
+    return broken == 0;
+}
+
+
+// vision kernels: one pixel at a time references, the 3x3 window clamped at the edges
+static uint8_t clamped_at(const uint8_t* p, size_t w, size_t h, long x, long y)
+{
+    x = std::min(std::max(x, 0L), long(w) - 1);
+    y = std::min(std::max(y, 0L), long(h) - 1);
+    return p[y * w + x];
+}
+
+static void box_blur_ref(const uint8_t* src, uint8_t* dst, size_t w, size_t h)
+{
+    for (size_t y = 0; y < h; y++)
+        for (size_t x = 0; x < w; x++)
+        {
+            uint32_t sum = 0;
+            for (int dy = -1; dy <= 1; dy++)
+                for (int dx = -1; dx <= 1; dx++)
+                    sum += clamped_at(src, w, h, long(x) + dx, long(y) + dy);
+            dst[y * w + x] = (sum * 2 + 9) / 18;
+        }
+}
+
+static void gaussian_blur_ref(const uint8_t* src, uint8_t* dst, size_t w, size_t h)
+{
+    const int k[3] = {1, 2, 1};
+    for (size_t y = 0; y < h; y++)
+        for (size_t x = 0; x < w; x++)
+        {
+            uint32_t sum = 0;
+            for (int dy = -1; dy <= 1; dy++)
+                for (int dx = -1; dx <= 1; dx++)
+                    sum += k[dy + 1] * k[dx + 1] * clamped_at(src, w, h, long(x) + dx, long(y) + dy);
+            dst[y * w + x] = (sum + 8) / 16;
+        }
+}
+
+static void sobel_ref(const uint8_t* src, uint8_t* dst, size_t w, size_t h)
+{
+    const int kx[3][3] = {{-1, 0, 1}, {-2, 0, 2}, {-1, 0, 1}};
+    for (size_t y = 0; y < h; y++)
+        for (size_t x = 0; x < w; x++)
+        {
+            int gx = 0;
+            int gy = 0;
+            for (int dy = -1; dy <= 1; dy++)
+                for (int dx = -1; dx <= 1; dx++)
+                {
+                    int p = clamped_at(src, w, h, long(x) + dx, long(y) + dy);
+                    gx += kx[dy + 1][dx + 1] * p;
+                    gy += kx[dx + 1][dy + 1] * p;
+                }
+            dst[y * w + x] = std::min((abs(gx) + abs(gy)) / 4, 255);
+        }
+}
+
+// 8-connected flood fill of the thresholded gaussian blur, blobs largest first
+static std::vector<blob> find_blobs_ref(const uint8_t* luma, size_t w, size_t h, uint8_t level)
+{
+    std::vector<uint8_t> mask(w * h);
+    gaussian_blur_ref(luma, mask.data(), w, h);
+    for (auto& m : mask)
+    {
+        m = m > level;
+    }
+
+    std::vector<blob> blobs;
+    std::vector<size_t> stack;
+    for (size_t i = 0; i < w * h; i++)
+    {
+        if (mask[i] != 1)
+        {
+            continue;
+        }
+        blob b = {0, 0, 0, uint16_t(i % w), uint16_t(i / w), uint16_t(i % w), uint16_t(i / w)};
+        mask[i] = 2;
+        stack.push_back(i);
+        while (!stack.empty())
+        {
+            size_t p = stack.back();
+            stack.pop_back();
+            uint16_t x = p % w;
+            uint16_t y = p / w;
+            b.area++;
+            b.sum_x += x;
+            b.sum_y += y;
+            b.x0 = std::min(b.x0, x);
+            b.y0 = std::min(b.y0, y);
+            b.x1 = std::max(b.x1, x);
+            b.y1 = std::max(b.y1, y);
+            for (int dy = -1; dy <= 1; dy++)
+                for (int dx = -1; dx <= 1; dx++)
+                {
+                    long nx = long(x) + dx;
+                    long ny = long(y) + dy;
+                    if (nx >= 0 && ny >= 0 && nx < long(w) && ny < long(h) && mask[ny * w + nx] == 1)
+                    {
+                        mask[ny * w + nx] = 2;
+                        stack.push_back(ny * w + nx);
+                    }
+                }
+        }
+        blobs.push_back(b);
+    }
+    std::stable_sort(blobs.begin(), blobs.end(), [](const blob& a, const blob& b) { return a.area > b.area; });
+    return blobs;
+}
+
+static bool same_blobs(const blob* a, size_t count, const std::vector<blob>& ref)
+{
+    // equal areas may come in any order, compare as sets
+    if (count != ref.size())
+    {
+        return false;
+    }
+    auto key = [](const blob& b) { return std::make_tuple(b.area, b.sum_x, b.sum_y, b.x0, b.y0, b.x1, b.y1); };
+    std::vector<decltype(key(ref[0]))> x, y;
+    for (size_t i = 0; i < count; i++)
+    {
+        x.push_back(key(a[i]));
+        y.push_back(key(ref[i]));
+    }
+    std::sort(x.begin(), x.end());
+    std::sort(y.begin(), y.end());
+    return x == y;
+}
+
+static bool bench_vision(const std::vector<luma_frame>& frames)
+{
+    typedef void (*ref_t)(const uint8_t* src, uint8_t* dst, size_t w, size_t h);
+    struct kernel_entry
+    {
+        const char* name;
+        row_kernel_t kernel;
+        ref_t ref;
+    };
+    const kernel_entry kernels[] = {
+        {"box blur", box_blur_row, box_blur_ref},
+        {"gaussian blur", gaussian_blur_row, gaussian_blur_ref},
+        {"sobel", sobel_row, sobel_ref},
+    };
+    const int rounds = 200;
+    bool ok = true;
+
+    // the multiply and shift division of the box blur, every possible sum
+    for (uint32_t sum = 0; sum <= 9 * 255; sum++)
+    {
+        alignas(4) uint8_t rows[3][3];
+        for (int i = 0; i < 9; i++)
+        {
+            rows[i / 3][i % 3] = sum / 9 + (i < int(sum % 9));
+        }
+        uint8_t out[3];
+        box_blur_row(rows[0], rows[1], rows[2], out, 3);
+        ok &= out[1] == (sum * 2 + 9) / 18;
+    }
+    printf("== vision kernels, %zu frames, %d rounds\n", frames.size(), rounds);
+    printf("box blur division %s\n", ok ? "exact" : "MISMATCH");
+
+    for (auto& k : kernels)
+    {
+        double us = 0;
+        double cycles = 0;
+        size_t pixels = 0;
+        size_t broken = 0;
+        for (auto& f : frames)
+        {
+            std::vector<uint8_t> out(f.y.size()), ref(f.y.size());
+            auto start = std::chrono::steady_clock::now();
+#ifdef HAVE_TSC
+            uint64_t tsc = __rdtsc();
+#endif
+            for (int r = 0; r < rounds; r++)
+            {
+                apply_row_kernel(k.kernel, f.y.data(), out.data(), f.width, f.height);
+                asm volatile("" ::: "memory");
+            }
+#ifdef HAVE_TSC
+            cycles += double(__rdtsc() - tsc) / rounds;
+#endif
+            us += elapsed_us(start) / rounds;
+            pixels += f.y.size();
+
+            k.ref(f.y.data(), ref.data(), f.width, f.height);
+            broken += out != ref;
+        }
+        printf("%-14s %7.2fus/frame %5.2f cycles/pixel, %zu/%zu frames match the reference\n", k.name,
+               us / frames.size(), cycles / pixels, frames.size() - broken, frames.size());
+        ok &= broken == 0;
+    }
+
+    // blobs above the Otsu level of the capture histogram
+    double us = 0;
+    double cycles = 0;
+    size_t pixels = 0;
+    size_t broken = 0;
+    size_t found = 0;
+    blob_finder finder;
+    blob blobs[BLOB_MAX_LABELS];
+    for (auto& f : frames)
+    {
+        luma_stats stats;
+        luma_histogram histogram;
+        histogram.begin(f.y.data(), pixel_format::Y8, &stats);
+        histogram.finish(f.y.size());
+        uint8_t level = otsu_level(stats);
+
+        std::vector<uint8_t> scratch(f.width);
+        size_t count = 0;
+        auto start = std::chrono::steady_clock::now();
+#ifdef HAVE_TSC
+        uint64_t tsc = __rdtsc();
+#endif
+        for (int r = 0; r < rounds; r++)
+        {
+            count = find_blobs(f.y.data(), f.width, f.height, level, scratch.data(), finder, blobs, BLOB_MAX_LABELS);
+        }
+#ifdef HAVE_TSC
+        cycles += double(__rdtsc() - tsc) / rounds;
+#endif
+        us += elapsed_us(start) / rounds;
+        pixels += f.y.size();
+        found += count;
+
+        // the finder drops runs past its capacity, the reference has none
+        broken += finder.get_dropped_runs() == 0 && !same_blobs(blobs, count, find_blobs_ref(f.y.data(), f.width, f.height, level));
+    }
+    printf("%-14s %7.2fus/frame %5.2f cycles/pixel, %.1f blobs/frame, %zu/%zu frames match the flood fill\n", "blobs",
+           us / frames.size(), cycles / pixels, double(found) / frames.size(), frames.size() - broken, frames.size());
+    return ok && broken == 0;
+}
+
+
+// motion detector, first on the recording as it is, nobody knows what moves there: trigger rate and link bytes
+// then on sequences made of its first frame where the truth is known: sensor noise, a light ramp (auto exposure),
+// a square moving across. every event on a still sequence is a false trigger
+struct motion_case
+{
+    const char* name;
+    int noise;          // uniform +-noise per pixel
+    int light;          // peak of a triangle ramp of the whole scene, 1 luma per frame
+    bool square;
+};
+
+struct motion_run
+{
+    size_t compared = 0;    // frames after the warmup
+    size_t events = 0;
+    size_t covered = 0;     // events whose box holds the center of the square
+    double us = 0;
+    double cycles = 0;
+    double bytes = 0;       // link bytes, events, plus a frame with every event and every keyframe
+};
+
+static motion_run run_motion(const std::vector<std::vector<uint8_t>>& seq, size_t w, size_t h,
+                             const std::vector<std::array<size_t, 2>>& squares, size_t side)
+{
+    motion_run run;
+    motion_detector detector;
+    for (size_t n = 0; n < seq.size(); n++)
+    {
+        motion_record event;
+        auto start = std::chrono::steady_clock::now();
+#ifdef HAVE_TSC
+        uint64_t tsc = __rdtsc();
+#endif
+        bool moved = detector.update(seq[n].data(), w, h, event);
+#ifdef HAVE_TSC
+        run.cycles += double(__rdtsc() - tsc);
+#endif
+        run.us += elapsed_us(start);
+        run.compared += n >= MOTION_WARMUP_FRAMES;
+
+        if (moved)
+        {
+            ++run.events;
+            if (!squares.empty())
+            {
+                size_t cx = squares[n][0] + side / 2, cy = squares[n][1] + side / 2;
+                run.covered += event.x0 <= cx && event.x1 >= cx && event.y0 <= cy && event.y1 >= cy;
+            }
+            run.bytes += 2 * sizeof(frame_header) + sizeof(motion_record) + w * h;
+        }
+        else if (n % MOTION_BENCH_KEYFRAME == 0)
+        {
+            run.bytes += sizeof(frame_header) + w * h;
+        }
+    }
+    return run;
+}
+
+static void print_motion_run(const char* name, const motion_run& run, size_t frames, size_t w, size_t h)
+{
+    printf("%-14s %6.2fus/frame %5.2f cycles/pixel, events %4zu/%zu frames, link %6.0f bytes/frame (%.0fx less than every frame)",
+           name, run.us / frames, run.cycles / (double(frames) * w * h), run.events, run.compared, run.bytes / frames,
+           double(sizeof(frame_header) + w * h) * frames / run.bytes);
+}
+
+static bool bench_motion(const std::vector<luma_frame>& frames)
+{
+    const size_t w = frames[0].width;
+    const size_t h = frames[0].height;
+    const size_t length = 1200;
+    printf("== motion detector, %zux%zu, %ux%u blocks, keyframe every %zu frames\n", w, h, MOTION_BLOCK, MOTION_BLOCK,
+           MOTION_BENCH_KEYFRAME);
+
+    std::vector<std::vector<uint8_t>> seq;
+    for (auto& f : frames)
+    {
+        if (f.width == w && f.height == h)
+        {
+            seq.push_back(f.y);
+        }
+    }
+    motion_run recorded = run_motion(seq, w, h, {}, 0);
+    print_motion_run("recording", recorded, seq.size(), w, h);
+    printf("\n");
+
+    const motion_case cases[] = {
+        {"still", 2, 0, false},
+        {"still, noisy", 4, 0, false},
+        {"light ramp", 2, 40, false},
+        {"moving square", 2, 0, true},
+        {"square + ramp", 2, 40, true},
+    };
+    const size_t side = std::min<size_t>(10, std::min(w, h) / 3);
+    bool ok = true;
+    for (auto& c : cases)
+    {
+        uint32_t random = 12345;
+        std::vector<std::array<size_t, 2>> squares;
+        seq.assign(length, std::vector<uint8_t>(w * h));
+        for (size_t n = 0; n < length; n++)
+        {
+            int light = c.light ? int(n % (2 * c.light)) : 0;
+            light = light < c.light ? light : 2 * c.light - light;
+            for (size_t i = 0; i < w * h; i++)
+            {
+                random = random * 1664525 + 1013904223;
+                int noise = int((random >> 16) % (2 * c.noise + 1)) - c.noise;
+                seq[n][i] = std::clamp<int>(frames[0].y[i] + light + noise, 0, 255);
+            }
+
+            // 4 pixels a frame, bouncing, bright on a dark place, dark on a bright one
+            size_t span = w - side;
+            size_t step = (n * 4) % (2 * span);
+            size_t sx = step < span ? step : 2 * span - step;
+            size_t sy = (h - side) / 2;
+            if (c.square && n >= MOTION_WARMUP_FRAMES)
+            {
+                uint32_t sum = 0;
+                for (size_t y = sy; y < sy + side; y++)
+                {
+                    for (size_t x = sx; x < sx + side; x++)
+                    {
+                        sum += frames[0].y[y * w + x];
+                    }
+                }
+                uint8_t level = sum < 128 * side * side ? 240 : 10;
+                for (size_t y = sy; y < sy + side; y++)
+                {
+                    memset(&seq[n][y * w + sx], level, side);
+                }
+            }
+            squares.push_back({sx, sy});
+        }
+
+        motion_run run = run_motion(seq, w, h, c.square ? squares : std::vector<std::array<size_t, 2>>{}, side);
+        print_motion_run(c.name, run, length, w, h);
+        if (c.square)
+        {
+            printf(", square in the box %zu/%zu\n", run.covered, run.compared);
+            ok &= run.covered * 100 >= run.compared * 99;
+        }
+        else
+        {
+            printf(", false triggers %.2f%%\n", 100.0 * run.events / run.compared);
+            ok &= run.events * 100 <= run.compared;
+        }
+    }
+    return ok;
+}
+
+
+// pyramid levels against straightforward references, then the cost of every level alone and of all in one pass
+static void pyramid_ref(const uint8_t* y, size_t w, size_t h, std::vector<uint8_t>& half, std::vector<uint8_t>& quarter,
+                        std::vector<uint8_t>& oled)
+{
+    for (size_t n : {2, 4})
+    {
+        std::vector<uint8_t>& out = n == 2 ? half : quarter;
+        out.assign((w / n) * (h / n), 0);
+        for (size_t oy = 0; oy < h / n; oy++)
+        {
+            for (size_t ox = 0; ox < w / n; ox++)
+            {
+                uint32_t sum = 0;
+                for (size_t i = 0; i < n * n; i++)
+                {
+                    sum += y[(oy * n + i / n) * w + ox * n + i % n];
+                }
+                out[oy * (w / n) + ox] = (sum + n * n / 2) / (n * n);
+            }
+        }
+    }
+
+    // fit 128x64, nearest pixel, ordered dither
+    static const int bayer[4][4] = {{0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}};
+    double scale = std::min(128.0 / w, 64.0 / h);
+    size_t ow = std::max<size_t>(1, std::min<size_t>(128, size_t(w * scale + 1e-9)));
+    size_t oh = std::max<size_t>(1, std::min<size_t>(64, size_t(h * scale + 1e-9)));
+    size_t x0 = (128 - ow) / 2, y0 = (64 - oh) / 2;
+    oled.assign(PYRAMID_OLED_BYTES, 0);
+    oled[0] = 0x40;
+    for (size_t oy = y0; oy < y0 + oh; oy++)
+    {
+        for (size_t ox = x0; ox < x0 + ow; ox++)
+        {
+            uint8_t v = y[((oy - y0) * h / oh) * w + (ox - x0) * w / ow];
+            if (v >= bayer[oy % 4][ox % 4] * 16 + 8)
+            {
+                oled[1 + (oy / 8) * 128 + ox] |= 1 << (oy % 8);
+            }
+        }
+    }
+}
+
+static bool bench_pyramid(const std::vector<luma_frame>& frames)
+{
+    const int rounds = 200;
+    size_t broken = 0;
+    printf("== luma pyramid, %zu frames, %d rounds\n", frames.size(), rounds);
+
+    struct
+    {
+        const char* name;
+        bool half, quarter, oled;
+    } cases[] = {
+        {"1/2 alone", true, false, false},
+        {"1/4 alone", false, true, false},
+        {"oled alone", false, false, true},
+        {"all, one pass", true, true, true},
+    };
+    double alone_us = 0;
+    for (auto& c : cases)
+    {
+        double us = 0;
+        double cycles = 0;
+        size_t pixels = 0;
+        for (auto& f : frames)
+        {
+            std::vector<uint8_t> half(pyramid_half_size(f.width, f.height)), quarter(pyramid_half_size(f.width / 2, f.height / 2));
+            std::vector<uint8_t> oled(PYRAMID_OLED_BYTES);
+            luma_pyramid pyramid{c.half ? half.data() : nullptr, c.quarter ? quarter.data() : nullptr, c.oled ? oled.data() : nullptr};
+            auto start = std::chrono::steady_clock::now();
+#ifdef HAVE_TSC
+            uint64_t tsc = __rdtsc();
+#endif
+            for (int r = 0; r < rounds; r++)
+            {
+                pyramid.begin(f.width, f.height);
+                pyramid.add_plane(f.y.data());
+                asm volatile("" ::: "memory");
+            }
+#ifdef HAVE_TSC
+            cycles += double(__rdtsc() - tsc) / rounds;
+#endif
+            us += elapsed_us(start) / rounds;
+            pixels += f.y.size();
+
+            if (c.half && c.quarter && c.oled)
+            {
+                std::vector<uint8_t> half_ref, quarter_ref, oled_ref;
+                pyramid_ref(f.y.data(), f.width, f.height, half_ref, quarter_ref, oled_ref);
+                broken += half != half_ref || quarter != quarter_ref || oled != oled_ref;
+            }
+        }
+        alone_us += c.half && c.quarter && c.oled ? 0 : us;
+        printf("%-14s %7.2fus/frame %5.2f cycles/pixel", c.name, us / frames.size(), cycles / pixels);
+        if (c.half && c.quarter && c.oled)
+        {
+            printf(", %.2fus for the levels one by one, %zu/%zu frames match the reference", alone_us / frames.size(),
+                   frames.size() - broken, frames.size());
+        }
+        printf("\n");
+    }
+    return broken == 0;
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s record.bin\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<luma_frame> frames = load_frames(argv[1]);
+    if (frames.empty())
+    {
+        fprintf(stderr, "no frame in %s\n", argv[1]);
+        return 1;
+    }
+    printf("%zu frames loaded\n", frames.size());
+
+    bench_pixel(frames[0].width, frames[0].height);
+    bench_delta(frames);
+    bool ok = bench_histogram(frames);
+    ok &= bench_vision(frames);
+    ok &= bench_motion(frames);
+    ok &= bench_pyramid(frames);
+    return bench_qoi(frames) && ok ? 0 : 1;
+}
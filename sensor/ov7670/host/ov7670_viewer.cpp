@@ -0,0 +1,323 @@
+/*
+PC side viewer of the ov7670 binary frames (frame_protocol.h)
+read frames from the pico COM port or from a recorded byte stream, verify them,
+count dropped frames and report fps and latency.
+
+build: g++ -O2 -std=c++17 -o ov7670_viewer ov7670_viewer.cpp ../delta_codec.cpp ../qoi_codec.cpp
+
+usage:
+    ov7670_viewer -d /dev/ttyACM0 [-m y|u|c|d|q|x|b|m|t] [-w x,y,width,height] [-r record.bin] [-p frame.pgm] [-a]
+    ov7670_viewer -f record.bin [-p frame.pgm] [-a]
+
+-d  COM port of the pico, the viewer sends the mode command ('y' luma only, 'u' sensor format, 'c' RGB565, 'd' luma delta, 'q' sensor format QOI,
+    'x' sobel edges, 'b' bright blobs instead of pixels, 'm' motion events and a frame only when something moves,
+    't' luma thumbnail at half the size)
+-w  capture a region of interest of the 80x60 frame only, width must be even
+-f  replay a recorded byte stream, no hardware needed
+-r  record the raw bytes from the COM port
+-p  write the latest frame as a PGM image (luma)
+-a  print the latest frame as ascii image, or its blob list, and every motion event
+
+latency: device latency = send_us - capture_us (device clock)
+link latency is measured against the smallest host arrival - send_us seen so far,
+the two clocks are not synchronized, so it is the latency above the fastest frame
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <time.h>
+#include <string>
+#include <algorithm>
+#include "frame_decoder.h"
+#include "../pixel_convert.h"
+
+static const char charmap[71] = "$@B%8&WM#*oahkbdpqwmZO0QLCJUYXzcvunxrjft/\\|()1{}[]?-_+~<>i!lI;:,\"^`'. ";
+
+struct latency_stats
+{
+    uint64_t count = 0;
+    double sum = 0;
+    double max = 0;
+
+    void add(double v)
+    {
+        ++count;
+        sum += v;
+        max = std::max(max, v);
+    }
+    double mean() const { return count ? sum / count : 0; }
+};
+
+
+static uint64_t host_time_us()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+static int open_port(const char* path)
+{
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    termios tio;
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 1;    // 100ms read timeout
+    tcsetattr(fd, TCSANOW, &tio);
+    return fd;
+}
+
+
+// luma of pixel i, Y8, Y,U,Y,V or RGB565
+static uint8_t luma_at(const decoded_frame& f, size_t i)
+{
+    uint8_t y;
+    switch (pixel_format(f.header.format))
+    {
+    case pixel_format::YUV422:
+        return f.payload[2 * i];
+    case pixel_format::RGB565:
+        rgb565_to_luma_ref(&f.payload[2 * i], &y, 1);
+        return y;
+    default:
+        return f.payload[i];
+    }
+}
+
+
+static void write_pgm(const decoded_frame& f, const char* path)
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp)
+    {
+        perror(path);
+        return;
+    }
+    fprintf(fp, "P5\n%d %d\n255\n", f.header.width, f.header.height);
+    for (size_t i = 0; i < size_t(f.header.width) * f.header.height; i++)
+    {
+        fputc(luma_at(f, i), fp);
+    }
+    fclose(fp);
+}
+
+
+static void print_ascii(const decoded_frame& f)
+{
+    std::string out = "\x1b[H";
+    for (size_t y = 0; y < f.header.height; y++)
+    {
+        for (size_t x = 0; x < f.header.width; x++)
+        {
+            out += charmap[70 - luma_at(f, y * f.header.width + x) * 10 / 37];
+        }
+        out += '\n';
+    }
+    fputs(out.c_str(), stdout);
+}
+
+
+static void print_blobs(const decoded_frame& f)
+{
+    size_t count = f.payload.size() / sizeof(blob_record);
+    printf("\x1b[H\x1b[J%zu blobs in %dx%d, sequence %u\n", count, f.header.width, f.header.height, f.header.sequence);
+    for (size_t i = 0; i < count; i++)
+    {
+        blob_record b;
+        memcpy(&b, &f.payload[i * sizeof(b)], sizeof(b));
+        printf("area %5u, centroid %6.2f,%6.2f, box %d,%d - %d,%d\n", b.area, b.centroid_x16 / 16.0, b.centroid_y16 / 16.0,
+               b.x0, b.y0, b.x1, b.y1);
+    }
+}
+
+
+static void print_motion(const decoded_frame& f)
+{
+    motion_record m;
+    memcpy(&m, f.payload.data(), sizeof(m));
+    printf("motion at %uus, sequence %u: box %d,%d - %d,%d, %d/%d blocks, peak %d, mean %d, light %+d\n",
+           f.header.capture_us, f.header.sequence, m.x0, m.y0, m.x1, m.y1, m.blocks, m.grid_blocks, m.peak, m.mean, m.light);
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* device = nullptr;
+    const char* replay = nullptr;
+    const char* record = nullptr;
+    const char* pgm = nullptr;
+    char mode = 'y';
+    bool ascii = false;
+    int roi[4] = {-1, -1, -1, -1};
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:f:r:p:m:w:a")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd': device = optarg; break;
+        case 'f': replay = optarg; break;
+        case 'r': record = optarg; break;
+        case 'p': pgm = optarg; break;
+        case 'm': mode = optarg[0]; break;
+        case 'a': ascii = true; break;
+        case 'w': sscanf(optarg, "%d,%d,%d,%d", &roi[0], &roi[1], &roi[2], &roi[3]); break;
+        default:
+            fprintf(stderr, "usage: %s (-d port [-m y|u|c|d|q|x|b|m|t] [-w x,y,width,height] [-r record.bin] | -f record.bin) [-p frame.pgm] [-a]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!device == !replay)
+    {
+        fprintf(stderr, "one of -d or -f is needed\n");
+        return 1;
+    }
+
+    int fd = device ? open_port(device) : open(replay, O_RDONLY);
+    if (fd < 0)
+    {
+        perror(replay);
+        return 1;
+    }
+    if (device && write(fd, &mode, 1) != 1)
+    {
+        perror("send mode");
+    }
+    if (device && roi[3] >= 0)
+    {
+        const uint8_t cmd[5] = {'w', uint8_t(roi[0]), uint8_t(roi[1]), uint8_t(roi[2]), uint8_t(roi[3])};
+        if (write(fd, cmd, sizeof(cmd)) != sizeof(cmd))
+            perror("send roi");
+    }
+    FILE* rec = record ? fopen(record, "wb") : nullptr;
+
+    frame_decoder decoder;
+    decoded_frame frame;
+    latency_stats device_latency;
+    latency_stats link_latency;
+    int64_t min_offset = INT64_MAX;     // host arrival - send_us
+    uint64_t first_capture = 0;
+    uint64_t last_capture = 0;
+    uint32_t prev_capture = 0;
+    uint64_t start = host_time_us();
+    uint64_t last_report = start;
+    uint64_t report_frames = 0;
+    uint64_t report_bytes = 0;
+    uint64_t undecodable = 0;
+
+    uint8_t buf[4096];
+    while (true)
+    {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0)
+        {
+            perror("read");
+            break;
+        }
+        if (n == 0 && replay)
+        {
+            break;
+        }
+        if (rec)
+        {
+            fwrite(buf, 1, n, rec);
+        }
+
+        uint64_t now = host_time_us();
+        report_bytes += n;
+        decoder.feed(buf, n);
+        while (decoder.next_frame(frame))
+        {
+            const frame_header& h = frame.header;
+            device_latency.add(uint32_t(h.send_us - h.capture_us));
+
+            // device clock, unwrapped, for the replay fps
+            last_capture += first_capture ? uint32_t(h.capture_us - prev_capture) : 0;
+            first_capture = 1;
+            prev_capture = h.capture_us;
+
+            if (device)
+            {
+                int64_t offset = int64_t(now) - h.send_us;
+                min_offset = std::min(min_offset, offset);
+                link_latency.add(double(offset - min_offset));
+            }
+            ++report_frames;
+
+            if (h.encoding == uint8_t(frame_encoding::BLOBS))
+            {
+                if (ascii)
+                    print_blobs(frame);
+                continue;
+            }
+            if (h.encoding == uint8_t(frame_encoding::MOTION))
+            {
+                if (ascii)
+                    print_motion(frame);
+                continue;
+            }
+            if (pgm)
+            {
+                write_pgm(frame, pgm);
+            }
+            if (ascii)
+            {
+                print_ascii(frame);
+            }
+        }
+
+        // delta chain is broken, ask for a keyframe
+        if (device && decoder.get_stats().undecodable != undecodable)
+        {
+            undecodable = decoder.get_stats().undecodable;
+            const char keyframe = 'k';
+            if (write(fd, &keyframe, 1) != 1)
+            {
+                perror("send keyframe request");
+            }
+        }
+
+        // live report every second
+        if (device && now - last_report >= 1000000)
+        {
+            const decoder_stats& s = decoder.get_stats();
+            printf("fps %.1f, %.1fKB/s, frames %llu, dropped %llu, crc errors %llu, skipped bytes %llu, "
+                   "device latency %.1fms (max %.1fms), link latency +%.1fms (max +%.1fms)\n",
+                   report_frames * 1e6 / (now - last_report), report_bytes * 1e3 / (now - last_report),
+                   (unsigned long long)s.frames, (unsigned long long)s.dropped,
+                   (unsigned long long)s.crc_errors, (unsigned long long)s.skipped_bytes,
+                   device_latency.mean() / 1000, device_latency.max / 1000, link_latency.mean() / 1000, link_latency.max / 1000);
+            fflush(stdout);
+            last_report = now;
+            report_frames = 0;
+            report_bytes = 0;
+        }
+    }
+
+    const decoder_stats& s = decoder.get_stats();
+    double seconds = last_capture / 1e6;
+    printf("frames %llu, dropped %llu, crc errors %llu, bad headers %llu, skipped bytes %llu, undecodable %llu\n",
+           (unsigned long long)s.frames, (unsigned long long)s.dropped, (unsigned long long)s.crc_errors,
+           (unsigned long long)s.bad_headers, (unsigned long long)s.skipped_bytes, (unsigned long long)s.undecodable);
+    printf("device fps %.1f, device latency %.1fms (max %.1fms)\n",
+           seconds > 0 ? (s.frames - 1) / seconds : 0.0, device_latency.mean() / 1000, device_latency.max / 1000);
+
+    if (rec)
+    {
+        fclose(rec);
+    }
+    close(fd);
+    return 0;
+}
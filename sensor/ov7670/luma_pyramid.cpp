@@ -0,0 +1,144 @@
+#include "luma_pyramid.h"
+#include <string.h>
+
+// 4x4 ordered dither, a pixel lights up when its luma reaches the threshold of its place
+static const uint8_t BAYER_4X4[4][4] =
+{
+    {0, 8, 2, 10},
+    {12, 4, 14, 6},
+    {3, 11, 1, 9},
+    {15, 7, 13, 5},
+};
+
+luma_pyramid::luma_pyramid(uint8_t* half, uint8_t* quarter, uint8_t* oled)
+    : half_(half)
+    , quarter_(quarter)
+    , oled_(oled)
+{
+}
+
+void luma_pyramid::begin(size_t width, size_t height, const uint8_t* curve)
+{
+    width_ = width < PYRAMID_MAX_WIDTH ? width : PYRAMID_MAX_WIDTH;
+    stride_ = width;
+    height_ = height;
+    curve_ = curve;
+    line_ = 0;
+    memset(quarter_sum_, 0, sizeof(quarter_sum_));
+
+    if (!oled_ || !width_ || !height_)
+    {
+        return;
+    }
+
+    // the largest size of the frame aspect inside 128x64, one division per column, none per pixel
+    if (width_ * PYRAMID_OLED_HEIGHT >= height_ * PYRAMID_OLED_WIDTH)
+    {
+        oled_width_ = PYRAMID_OLED_WIDTH;
+        oled_height_ = height_ * PYRAMID_OLED_WIDTH / width_;
+    }
+    else
+    {
+        oled_height_ = PYRAMID_OLED_HEIGHT;
+        oled_width_ = width_ * PYRAMID_OLED_HEIGHT / height_;
+    }
+    oled_height_ = oled_height_ ? oled_height_ : 1;
+    oled_width_ = oled_width_ ? oled_width_ : 1;
+    oled_x0_ = (PYRAMID_OLED_WIDTH - oled_width_) / 2;
+    oled_y0_ = (PYRAMID_OLED_HEIGHT - oled_height_) / 2;
+    oled_row_ = 0;
+    for (size_t x = 0; x < oled_width_; x++)
+    {
+        oled_src_x_[x] = uint16_t(x * width_ / oled_width_);
+    }
+
+    memset(oled_, 0, PYRAMID_OLED_BYTES);
+    oled_[0] = 0x40;
+}
+
+void luma_pyramid::add_line(const uint8_t* line)
+{
+    const size_t y = line_++;
+    if (y >= height_)
+    {
+        return;
+    }
+
+    // oled rows sampled from this line, none or more than one when the frame is scaled
+    while (oled_ && oled_row_ < oled_height_ && oled_row_ * height_ / oled_height_ == y)
+    {
+        render_oled_row(line, oled_row_++);
+    }
+
+    if (y >= height_ / 2 * 2)
+    {
+        return;     // odd line out
+    }
+
+    // pixel pairs once, for both box filters
+    const size_t half_width = width_ / 2;
+    uint16_t pairs[PYRAMID_MAX_WIDTH / 2];
+    for (size_t x = 0; x < half_width; x++)
+    {
+        pairs[x] = line[2 * x] + line[2 * x + 1];
+    }
+
+    if (half_)
+    {
+        if (y & 1)
+        {
+            uint8_t* out = half_ + (y / 2) * half_width;
+            for (size_t x = 0; x < half_width; x++)
+            {
+                out[x] = (half_sum_[x] + pairs[x] + 2) >> 2;
+            }
+        }
+        else
+        {
+            memcpy(half_sum_, pairs, half_width * sizeof(pairs[0]));
+        }
+    }
+
+    if (quarter_ && y < height_ / 4 * 4)
+    {
+        const size_t quarter_width = width_ / 4;
+        for (size_t x = 0; x < quarter_width; x++)
+        {
+            quarter_sum_[x] += pairs[2 * x] + pairs[2 * x + 1];
+        }
+        if ((y & 3) == 3)
+        {
+            uint8_t* out = quarter_ + (y / 4) * quarter_width;
+            for (size_t x = 0; x < quarter_width; x++)
+            {
+                out[x] = (quarter_sum_[x] + 8) >> 4;
+                quarter_sum_[x] = 0;
+            }
+        }
+    }
+}
+
+void luma_pyramid::add_plane(const uint8_t* luma)
+{
+    for (size_t y = 0; y < height_; y++)
+    {
+        add_line(luma + y * stride_);
+    }
+}
+
+void luma_pyramid::render_oled_row(const uint8_t* line, size_t row)
+{
+    const size_t oy = oled_y0_ + row;
+    const uint8_t* thresholds = BAYER_4X4[oy & 3];
+    const uint8_t bit = 1u << (oy & 7);
+    uint8_t* page = oled_ + 1 + (oy / 8) * PYRAMID_OLED_WIDTH + oled_x0_;
+    for (size_t x = 0; x < oled_width_; x++)
+    {
+        uint8_t v = line[oled_src_x_[x]];
+        v = curve_ ? curve_[v] : v;
+        if (v >= thresholds[(oled_x0_ + x) & 3] * 16 + 8)
+        {
+            page[x] |= bit;
+        }
+    }
+}
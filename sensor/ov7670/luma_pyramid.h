@@ -0,0 +1,84 @@
+#ifndef LUMA_PYRAMID_H_
+#define LUMA_PYRAMID_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+luma pyramid of one captured frame, every consumer takes its own size, no second capture, no sensor switch
+    half: 2x2 box filter, 80x60 -> 40x30 thumbnail
+    quarter: 4x4 box filter, 80x60 -> 20x15
+    oled: 1 bit 128x64 image for the SSD1306, the frame scaled to fit, ordered dither
+
+the frame goes through once, a line at a time: the pixel pairs of a line are summed once
+and feed both box filters, the oled rows of the line are rendered from it.
+every level is a mean of the pixels below it, rounded, no error is carried from level to level.
+no SDK dependency, the PC side tools (host/) build luma_pyramid.cpp too
+*/
+
+const size_t PYRAMID_MAX_WIDTH = 640;
+const size_t PYRAMID_OLED_WIDTH = 128;
+const size_t PYRAMID_OLED_HEIGHT = 64;
+const size_t PYRAMID_OLED_BYTES = 1 + PYRAMID_OLED_WIDTH * PYRAMID_OLED_HEIGHT / 8;     // 0x40 data control byte, 8 pages
+
+// size of the half level buffer for a frame, the quarter level is half_size(half width, half height)
+inline constexpr size_t pyramid_half_size(size_t width, size_t height) { return (width / 2) * (height / 2); }
+
+struct pyramid_level
+{
+    const uint8_t* data;
+    size_t width;
+    size_t height;
+};
+
+
+class luma_pyramid
+{
+public:
+    /*
+    @param half, quarter level buffers, pyramid_half_size() of the largest frame, nullptr skips the level
+    @param oled PYRAMID_OLED_BYTES, laid out as oled_disp sends it: control byte 0x40, then page by page,
+                a byte is a column of 8 rows, bit 0 on top. nullptr skips the level
+    */
+    luma_pyramid(uint8_t* half, uint8_t* quarter, uint8_t* oled);
+
+    /*
+    start a frame
+    @param width the box filters take PYRAMID_MAX_WIDTH at most, odd lines and columns are left out of them
+    @param curve tone curve of the oled level, nullptr uses the luma as it is
+    */
+    void begin(size_t width, size_t height, const uint8_t* curve = nullptr);
+    void add_line(const uint8_t* line);     // lines in order, from the top
+    void add_plane(const uint8_t* luma);    // every line of a frame in memory
+
+    pyramid_level get_half() const { return {half_, width_ / 2, height_ / 2}; }
+    pyramid_level get_quarter() const { return {quarter_, width_ / 4, height_ / 4}; }
+    const uint8_t* get_oled() const { return oled_; }
+
+private:
+    void render_oled_row(const uint8_t* line, size_t row);
+
+private:
+    uint8_t* half_;
+    uint8_t* quarter_;
+    uint8_t* oled_;
+    const uint8_t* curve_ = nullptr;
+
+    size_t width_ = 0;
+    size_t height_ = 0;
+    size_t stride_ = 0;                     // of add_plane()
+    size_t line_ = 0;                       // next line
+    uint16_t half_sum_[PYRAMID_MAX_WIDTH / 2];      // 2x1 sums of the first line of a pair
+    uint16_t quarter_sum_[PYRAMID_MAX_WIDTH / 4];   // 4xn sums of the lines so far
+
+    // oled placement, the frame keeps its aspect ratio, centered
+    size_t oled_width_ = 0;
+    size_t oled_height_ = 0;
+    size_t oled_x0_ = 0;
+    size_t oled_y0_ = 0;
+    size_t oled_row_ = 0;                   // next oled row
+    uint16_t oled_src_x_[PYRAMID_OLED_WIDTH];
+};
+
+
+#endif
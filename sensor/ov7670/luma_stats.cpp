@@ -0,0 +1,132 @@
+#include "luma_stats.h"
+#include <string.h>
+#include "pixel_convert.h"
+
+void luma_histogram::begin(const uint8_t* buf, pixel_format format, luma_stats* stats)
+{
+    buf_ = buf;
+    format_ = format;
+    stats_ = stats;
+    done_ = 0;
+    memset(stats_->bins, 0, sizeof(stats_->bins));
+}
+
+void luma_histogram::feed(size_t bytes, size_t max_bytes)
+{
+    // whole words only, the DMA writes one word at a time
+    size_t end = bytes & ~size_t(3);
+    if (max_bytes && end > done_ + max_bytes)
+    {
+        end = done_ + (max_bytes & ~size_t(3));
+    }
+    if (!stats_ || end <= done_)
+    {
+        return;
+    }
+
+    uint32_t* bins = stats_->bins;
+    const uint8_t* p = buf_ + done_;
+    const uint8_t* stop = buf_ + end;
+    if (format_ == pixel_format::Y8)
+    {
+        for (; p != stop; p += 4)
+        {
+            uint32_t w = load_word(p);
+            ++bins[w & 0xff];
+            ++bins[(w >> 8) & 0xff];
+            ++bins[(w >> 16) & 0xff];
+            ++bins[w >> 24];
+        }
+    }
+    else if (format_ == pixel_format::RGB565)
+    {
+        for (; p != stop; p += 4)
+        {
+            uint32_t y = rgb565_luma_pair(load_word(p));
+            ++bins[y & 0xff];
+            ++bins[y >> 8];
+        }
+    }
+    else
+    {
+        // Y0 and Y1 are the bytes 0 and 2 of every word
+        for (; p != stop; p += 4)
+        {
+            uint32_t w = load_word(p);
+            ++bins[w & 0xff];
+            ++bins[(w >> 16) & 0xff];
+        }
+    }
+    done_ = end;
+}
+
+void luma_histogram::finish(size_t len)
+{
+    if (!stats_)
+    {
+        return;
+    }
+    feed(len);
+
+    luma_stats& s = *stats_;
+    s.count = 0;
+    s.sum = 0;
+    s.min = 255;
+    s.max = 0;
+    for (uint32_t y = 0; y < 256; y++)
+    {
+        if (!s.bins[y])
+        {
+            continue;
+        }
+        s.count += s.bins[y];
+        s.sum += s.bins[y] * y;
+        s.min = y < s.min ? y : s.min;
+        s.max = y;
+    }
+    if (!s.count)
+    {
+        s.min = 0;
+    }
+}
+
+void build_tone_curve(const luma_stats& stats, contrast_mode mode, uint8_t (&curve)[256])
+{
+    for (uint32_t y = 0; y < 256; y++)
+    {
+        curve[y] = y;
+    }
+    if (!stats.count || mode == contrast_mode::LINEAR)
+    {
+        return;
+    }
+
+    if (mode == contrast_mode::STRETCH)
+    {
+        uint32_t low = stats.percentile(STRETCH_LOW_PER_MILLE);
+        uint32_t high = stats.percentile(STRETCH_HIGH_PER_MILLE);
+        if (high <= low)
+        {
+            return;     // flat frame, nothing to stretch
+        }
+        for (uint32_t y = 0; y < 256; y++)
+        {
+            uint32_t v = y <= low ? 0 : (y >= high ? 255 : (y - low) * 255 / (high - low));
+            curve[y] = v;
+        }
+        return;
+    }
+
+    // equalization, cdf of the darkest level maps to 0
+    uint32_t cdf_min = stats.bins[stats.min];
+    if (stats.count == cdf_min)
+    {
+        return;
+    }
+    uint32_t cdf = 0;
+    for (uint32_t y = 0; y < 256; y++)
+    {
+        cdf += stats.bins[y];
+        curve[y] = cdf <= cdf_min ? 0 : uint64_t(cdf - cdf_min) * 255 / (stats.count - cdf_min);
+    }
+}
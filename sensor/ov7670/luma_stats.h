@@ -0,0 +1,94 @@
+#ifndef LUMA_STATS_H_
+#define LUMA_STATS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "frame_protocol.h"
+
+/*
+luma histogram of a frame, built while the frame is being captured
+the capture core trails the DMA write pointer and counts the bytes already in memory,
+the DMA interrupt counts the few bytes left, so the statistics are ready with the frame and no second pass is needed.
+
+only the bins are updated per pixel, min, max, mean and percentiles are derived from the 256 bins.
+no SDK dependency, the PC side tools (host/) build luma_stats.cpp too
+*/
+
+struct luma_stats
+{
+    uint32_t bins[256];
+    uint32_t count;     // pixels
+    uint32_t sum;       // luma sum, mean = sum / count
+    uint8_t min;
+    uint8_t max;
+
+    uint8_t mean() const { return count ? sum / count : 0; }
+
+    // lowest luma with at least per_mille / 1000 of the pixels at or below it
+    uint8_t percentile(uint32_t per_mille) const
+    {
+        uint32_t target = uint32_t((uint64_t(count) * per_mille + 999) / 1000);
+        uint32_t seen = 0;
+        for (uint32_t y = 0; y < 256; y++)
+        {
+            seen += bins[y];
+            if (seen && seen >= target)
+            {
+                return y;
+            }
+        }
+        return max;
+    }
+};
+
+
+/*
+incremental histogram builder, one frame at a time
+    begin(buf, format, &stats)
+    feed(bytes_in_memory) any number of times, from one context at a time
+    finish(len)
+*/
+class luma_histogram
+{
+public:
+    /*
+    start a frame, the bins are cleared
+    @param buf frame buffer, 4 bytes aligned
+    @param format YUV422 or RGB565, 2 bytes per pixel, or Y8
+    */
+    void begin(const uint8_t* buf, pixel_format format, luma_stats* stats);
+
+    /*
+    count the pixels of the complete words below bytes
+    @param max_bytes upper bound of the work done by this call, 0 no bound
+    */
+    void feed(size_t bytes, size_t max_bytes = 0);
+
+    // count the rest of the frame of len bytes and derive min, max, mean
+    void finish(size_t len);
+
+    size_t get_done() const { return done_; }
+
+private:
+    const uint8_t* buf_ = nullptr;
+    pixel_format format_ = pixel_format::YUV422;
+    luma_stats* stats_ = nullptr;
+    size_t done_ = 0;
+};
+
+
+/*
+tone curves, luma -> display luma, rebuilt per frame from the statistics
+    LINEAR: identity
+    STRETCH: the 1% .. 99% percentile range is stretched to 0 .. 255
+    EQUALIZE: histogram equalization, every output level gets about the same number of pixels
+*/
+enum class contrast_mode { LINEAR, STRETCH, EQUALIZE };
+
+const uint32_t STRETCH_LOW_PER_MILLE = 10;
+const uint32_t STRETCH_HIGH_PER_MILLE = 990;
+
+void build_tone_curve(const luma_stats& stats, contrast_mode mode, uint8_t (&curve)[256]);
+
+
+#endif
@@ -1,8 +1,12 @@
 /*
-read image from ov7670 directly by pico gpio and convert to greyscale ascii image,
+read image from ov7670 by pico PIO + DMA and convert to greyscale ascii image,
 send to PC through pico COM port.
+core1 captures frames into a timestamped frame store, core0 converts and sends a previous frame.
+line stream mode captures any size through a small ring of lines, each line is converted and sent before the ring wraps.
+PC can switch the output to binary frames (frame_protocol.h) by sending a command character, see poll_command()
 resolution: 60x80
-color format: YUV422
+color format: YUV422 or RGB565, chosen at runtime, the per pixel code is specialized per format (pixel_convert.h)
+luma only build (OV7670_LUMA_ONLY, frame_format.h): the Y bytes of YUV422 only, half the frame memory
 
 [wiring]
 ov7076: SDA -> pico GPIO4
@@ -27,28 +31,148 @@ be careful about wiring
 */
 
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include <pico/stdlib.h>
+#include <pico/stdio_usb.h>
 #include <hardware/i2c.h>
 #include <hardware/clocks.h>
-#include <string>
+#include <hardware/structs/systick.h>
 #include "reg_config.h"
+#include "pio_capture.h"
+#include "frame_pipeline.h"
+#include "frame_protocol.h"
+#include "ascii_render.h"
+#include "delta_codec.h"
+#include "sccb_shadow.h"
+#include "pixel_convert.h"
+#include "perf_stats.h"
+#include "ov7670_window.h"
+#include "qoi_codec.h"
+#include "rate_controller.h"
+#include "luma_stats.h"
+#include "vision_kernels.h"
+#include "motion_detector.h"
+#include "luma_pyramid.h"
 
 
-void i2c_write_register(i2c_inst_t* i2c, uint8_t addr, uint8_t reg, uint8_t val);   // addr is device address
-uint8_t i2c_read_register(i2c_inst_t* i2c, uint8_t addr, uint8_t reg);              // addr is device address
-
-// ov7670 function
+// ov7670 function, registers are written through the shadow, only changed values go to the sensor
 void ov7670_init();
-void set_size(OV7670_SIZE size);
 void set_image_format(OV7670_COLOR color);
-void capture_frame();                                    // determin one frame is arrived
-void perform_capture_frame();                            // do capture frame
-bool capture_frame_callback(repeating_timer_t* rt);      // timer alarm callback function
+void set_mode(OV7670_SIZE size, OV7670_COLOR color);     // size and format in one pass, report the cost, every size goes through it
+bool set_roi(const frame_roi& roi);                      // window of the current size, between two frames
+void capture_frame();                                    // take one captured frame from core1, convert and send
+template <pixel_format F>
+void process_frame(const frame_info& frame);             // everything after the capture, specialized per sensor format
+template <pixel_format F>
+void perform_capture_frame(const frame_info& frame);     // convert captured frame and send to PC
+template <pixel_format F>
+const uint8_t* luma_plane(const frame_info& frame);      // luma_image, or the frame itself when it is luma only
+bool capture_frame_callback(repeating_timer_t* rt);      // timer alarm callback function, asks for one frame
+void schedule_benchmark();                               // core idle fraction at every capture rate
+
+// output format, switched by a command character from PC
+// 'a': ascii image and log lines (default)
+// 'y': binary frames, luma only
+// 'u': binary frames, sensor format as it is, YUV422 or RGB565
+// 'c': binary frames, RGB565
+// 'd': binary frames, luma only, changed tiles against the previous frame
+// 'q': binary frames, sensor format, lossless QOI, raw when it doesn't get smaller
+// 'x': binary frames, sobel edges of the luma
+// 'b': blob list of the bright regions instead of pixels, above the Otsu level of the frame histogram
+// 'm': motion events only, a luma frame with every event and every MOTION_KEYFRAME_MS
+// 't': binary frames, luma thumbnail, half the captured size
+// 'k': next delta frame is a keyframe, PC asks for it when the delta chain is broken
+// 'Y': sensor outputs YUV422
+// 'R': sensor outputs RGB565
+// 'w' x y width height: capture the region of interest only, 4 bytes follow, 'W': full frame
+// 'o': print the sensor clock operating point
+// 'p': print the per stage latency histograms, 'P': clear them
+// 'l': ascii luma as it is, 's': stretch 1%..99% to full range, 'e': histogram equalization
+// '0': capture every frame, '2'-'9': capture one frame out of n, 'f': capture one frame now, then on demand only
+enum class output_mode { ASCII, BINARY_Y8, BINARY_NATIVE, BINARY_RGB565, BINARY_DELTA_Y8, BINARY_QOI, BINARY_EDGES, BINARY_BLOBS, BINARY_MOTION, BINARY_THUMBNAIL };
+void poll_command();
+void set_output_mode(output_mode mode);
+void set_sensor_format(pixel_format format);
+template <pixel_format F>
+void send_binary_frame(const frame_info& frame, pixel_format format, frame_encoding encoding = frame_encoding::RAW);
+template <pixel_format F>
+void send_vision_frame(const frame_info& frame, bool blobs);    // results of the vision kernels, edges or blobs
+template <pixel_format F>
+void send_motion_frame(const frame_info& frame);         // nothing while the scene is still
+template <pixel_format F>
+void send_thumbnail_frame(const frame_info& frame);      // half level of the pyramid
+void write_frame(const frame_info& frame, pixel_format format, frame_encoding encoding, const uint8_t* payload, size_t len);
+void convert_benchmark();                                // cycles of every pixel kernel on a captured frame
 
-// images
+// line stream, called for every line of the frame
+typedef void (*line_sink_t)(const uint8_t* line, size_t line_index, size_t width, size_t height);
+bool stream_frame(OV7670_SIZE size, line_sink_t sink);   // capture one frame line by line
+void null_sink(const uint8_t* line, size_t line_index, size_t width, size_t height);    // drop, capture only
+void ascii_sink(const uint8_t* line, size_t line_index, size_t width, size_t height);   // 80x60 ascii preview of any size
+void qoi_sink(const uint8_t* line, size_t line_index, size_t width, size_t height);     // lossless encode, count the bytes
+void stream_benchmark();                                 // every sink at every size, report sustained fps
+
+// images, captured frames live in the frame store of the pipeline
 uint32_t frame_count = 0;
-uint8_t yuv_image[60][160]; // bytes sequence is Y,U,Y,V,Y,U,Y,V
-char ascii_char_image[60][81];
+char ascii_image[FRAME_HEIGHT * (FRAME_WIDTH + 1)];   // 80 chars + '\n' per line, sent as it is
+alignas(4) uint8_t luma_image[FRAME_WIDTH * FRAME_HEIGHT];     // Y8 payload of the binary frame
+alignas(4) uint8_t rgb565_image[FRAME_WIDTH * FRAME_HEIGHT * 2];   // RGB565 payload of the binary frame
+uint8_t delta_reference[FRAME_WIDTH * FRAME_HEIGHT];    // what the PC has decoded so far
+uint8_t encoded_image[std::max(delta_max_encoded_size(FRAME_WIDTH, FRAME_HEIGHT), qoi_max_encoded_size(FRAME_WIDTH * FRAME_HEIGHT * 2))];
+delta_encoder encoder{delta_reference, FRAME_WIDTH, FRAME_HEIGHT};
+output_mode output = output_mode::ASCII;
+
+// vision kernels, the blobs are found a row at a time
+const size_t MAX_BLOBS = 16;
+blob_finder finder;
+uint8_t vision_row[FRAME_WIDTH];
+
+// motion events, a still scene sends a luma frame every MOTION_KEYFRAME_MS only
+const uint32_t MOTION_KEYFRAME_MS = 10000;
+motion_detector motion;
+uint32_t motion_keyframe_us = 0;
+
+// every size from the one capture, built in one pass over the luma plane, no sensor switch
+// oled_image is ready for oled_disp::oled_send_to_memory() of a 128x64 SSD1306
+uint8_t thumbnail_image[pyramid_half_size(FRAME_WIDTH, FRAME_HEIGHT)];           // 40x30
+uint8_t quarter_image[pyramid_half_size(FRAME_WIDTH / 2, FRAME_HEIGHT / 2)];     // 20x15
+uint8_t oled_image[PYRAMID_OLED_BYTES];
+luma_pyramid pyramid{thumbnail_image, quarter_image, oled_image};
+
+// auto contrast of the ascii image, the lut is rebuilt per frame from the histogram core1 built during the capture
+contrast_mode contrast = contrast_mode::STRETCH;
+ascii_lut contrast_lut;
+
+// frames captured before a format or window switch are dropped, they may be in the old format
+pixel_format sensor_format = pixel_format::YUV422;
+OV7670_SIZE current_size = OV7670_SIZE::OV7670_SIZE_DIV8;
+uint32_t last_sequence = 0;
+uint32_t format_valid_sequence = 0;
+
+// register shadow, read back every write when SCCB_VERIFY is set
+const bool SCCB_VERIFY = false;
+sccb_shadow sccb{i2c_instance, OV7670_ADDR};
+
+// sensor clock follows what the capture and the consumer can take
+rate_controller rate{sccb, GPIO_XCLK};
+
+// capture engine runs on core1, D0-D7 sampled by pio0
+pio_capture camera{pio0, GPIO_D0};
+capture_scheduler scheduler{GPIO_VSYNC};
+frame_pipeline pipeline{camera, scheduler};
+
+// 0: capture as fast as the sensor and the link go, otherwise the timer asks for one frame every period
+const uint32_t CAPTURE_PERIOD_MS = 0;
+repeating_timer capture_timer;
+
+// FRAME_PIPELINE: 80x60 frames are buffered, captured on core1, converted and sent on core0
+// LINE_STREAM: frames of any size are captured and sent line by line on core0, memory stays constant
+enum class capture_mode { FRAME_PIPELINE, LINE_STREAM };
+const capture_mode CAPTURE_MODE = capture_mode::FRAME_PIPELINE;
+const OV7670_SIZE STREAM_SIZE = OV7670_SIZE::OV7670_SIZE_DIV2;
+const size_t LINE_RING_LINES = 4;
+alignas(4) uint8_t line_ring[LINE_RING_LINES][640 * FRAME_PIXEL_BYTES];    // the longest line, VGA
 
 int main()
 {
@@ -57,26 +181,6 @@ int main()
     sleep_ms(5000);
     printf("start...\n");
 
-    // initialize data structure
-    for (size_t i = 0; i < 60; i++)
-    {
-        for (size_t j = 0; j < 160; j++)
-        {
-            yuv_image[i][j] = 'a';
-        }
-    }
-
-
-    for (size_t i = 0; i < 60; i++)
-    {
-        for (size_t j = 0; j < 80; j++)
-        {
-            ascii_char_image[i][j] = '$';
-        }
-        ascii_char_image[i][80] = '\0';
-    }
-
-    
     // initialize i2c
     i2c_init(i2c_instance, 100000);
     gpio_set_function(OV_SDA, GPIO_FUNC_I2C);
@@ -102,194 +206,850 @@ int main()
     
     // initialize ov7670
     // first step is set ov7670 clock, then set registers through SCCB
-    clock_gpio_init(GPIO_XCLK, CLOCKS_CLK_GPOUT0_CTRL_AUXSRC_VALUE_CLK_SYS, 10);
+    clock_gpio_init(GPIO_XCLK, CLOCKS_CLK_GPOUT0_CTRL_AUXSRC_VALUE_CLK_SYS, rate_points[RATE_DEFAULT_POINT].xclk_div);
     sleep_ms(300);  // add some settling time
     // config sensor
     ov7670_init();
-    
+    if (CAPTURE_MODE == capture_mode::LINE_STREAM)
+    {
+        camera.init_dev();
+        stream_benchmark();
+
+        set_mode(STREAM_SIZE, OV7670_COLOR::OV7670_COLOR_YUV);
+        uint32_t finished = 0;
+        uint32_t timeouts = 0;
+        uint32_t overrun_frames = 0;
+        while (1)
+        {
+            uint32_t overrun = camera.get_overrun_lines();
+            bool ok = stream_frame(STREAM_SIZE, ascii_sink);
+            ok ? ++finished : ++timeouts;
+            overrun = camera.get_overrun_lines() - overrun;
+            printf(">> stream frame %s, %.1f fps, overrun lines: %d\n", ok ? "finished" : "timeout", camera.get_fps(), overrun);
+
+            // a finished frame with overrun lines is the backpressure of the line stream, one lost frame however many lines
+            if (ok && overrun)
+            {
+                ++overrun_frames;
+            }
+            if (rate.update(finished, timeouts, overrun_frames))
+            {
+                rate.print();
+            }
+        }
+    }
 
-    // using timer will can not get correct image
-    // repeating_timer timer;
-    // add_repeating_timer_ms(2000, capture_frame_callback, nullptr, &timer);
+    // capture on core1, convert and transmit on core0
+    pipeline.start();
+    convert_benchmark();
+    schedule_benchmark();
+
+    // the timer only queues a request, core1 arms the capture on the next VSYNC
+    if (CAPTURE_PERIOD_MS)
+    {
+        scheduler.set_on_demand();
+        add_repeating_timer_ms(CAPTURE_PERIOD_MS, capture_frame_callback, nullptr, &capture_timer);
+    }
 
     while (1)
     {
         capture_frame();
-        sleep_ms(1000);
     }
 
     return 0;
 }
 
 
-void i2c_write_register(i2c_inst_t* i2c, uint8_t addr, uint8_t reg, uint8_t val)
+void stage_size(OV7670_SIZE size)
 {
-    uint8_t data[2] = {reg, val}; 
-    i2c_write_blocking(i2c, addr, data, 2, false);
+    switch (size)
+    {
+    case OV7670_SIZE::OV7670_SIZE_DIV1:
+        sccb.stage(ov7670_div1);
+        break;
+    case OV7670_SIZE::OV7670_SIZE_DIV2:
+        sccb.stage(ov7670_div2);
+        break;
+    case OV7670_SIZE::OV7670_SIZE_DIV4:
+        sccb.stage(ov7670_div4);
+        break;
+    case OV7670_SIZE::OV7670_SIZE_DIV8:
+        sccb.stage(ov7670_div8);
+        break;
+    case OV7670_SIZE::OV7670_SIZE_DIV16:
+        sccb.stage(ov7670_div16);
+        break;
+    }
 }
 
 
-uint8_t i2c_read_register(i2c_inst_t* i2c, uint8_t addr, uint8_t reg)
+void stage_image_format(OV7670_COLOR color)
 {
-    uint8_t value;
-    i2c_write_blocking(i2c, addr, &reg, 1, false);
-    i2c_read_blocking(i2c, addr, &value, 1, false);
-    return value;
+    if (color == OV7670_COLOR::OV7670_COLOR_RGB)
+    {
+        sccb.stage(ov7670_rgb);
+    } 
+    else if (color == OV7670_COLOR::OV7670_COLOR_YUV)
+    {
+        sccb.stage(ov7670_yuv);
+    }
+    // TODO add other colorspace
 }
 
 
-void set_size(OV7670_SIZE size)
+void stage_window(OV7670_SIZE size, const frame_roi& roi)
 {
-    if (size == OV7670_SIZE::OV7670_SIZE_DIV8)
+    i2c_command cmds[6];
+    if (ov7670_window_commands(size, roi, cmds))
     {
-        for (auto& cmd : ov7670_div8)
-            i2c_write_register(i2c_instance, OV7670_ADDR, cmd.addr, cmd.value);
+        sccb.stage(cmds);
     }
-    // TODO add other DIVS
 }
 
 
 void set_image_format(OV7670_COLOR color)
 {
-    if (color == OV7670_COLOR::OV7670_COLOR_RGB)
+    stage_image_format(color);
+    sccb.commit();
+}
+
+
+void set_mode(OV7670_SIZE size, OV7670_COLOR color)
+{
+    // the size tables also write COM7, the format tables write it again, staged together it is written once
+    uint32_t transactions = sccb.get_transactions();
+    uint32_t skipped = sccb.get_stats().skipped;
+    uint32_t start = time_us_32();
+    stage_size(size);
+    stage_window(size, ov7670_full_roi(size));
+    stage_image_format(color);
+    sccb.commit();
+    current_size = size;
+    uint32_t mismatches = SCCB_VERIFY ? sccb.verify_all() : 0;
+    uint32_t elapsed = time_us_32() - start;
+
+    printf(">> mode %dx%d %s: %d SCCB transactions, %d skipped, %.2f ms, read back mismatches: %d\n",
+           ov7670_width(size), ov7670_height(size), color == OV7670_COLOR::OV7670_COLOR_RGB ? "RGB" : "YUV",
+           sccb.get_transactions() - transactions, sccb.get_stats().skipped - skipped, elapsed / 1000.0f, mismatches);
+}
+
+
+bool set_roi(const frame_roi& roi)
+{
+    // the pipeline buffers hold the frame size, a region is never larger
+    i2c_command cmds[6];
+    if (!ov7670_window_commands(current_size, roi, cmds) || !pipeline.set_frame_size(roi.width, roi.height))
     {
-        for (auto& cmd : ov7670_rgb)
-            i2c_write_register(i2c_instance, OV7670_ADDR, cmd.addr, cmd.value);
-    } 
-    else if (color == OV7670_COLOR::OV7670_COLOR_YUV)
+        return false;
+    }
+
+    // only the window registers change, no reset and no init
+    uint32_t transactions = sccb.get_transactions();
+    uint32_t start = time_us_32();
+    sccb.apply(cmds);
+    uint32_t elapsed = time_us_32() - start;
+
+    encoder.set_size(roi.width, roi.height);
+    format_valid_sequence = last_sequence + FRAME_STORE_SLOTS + 1;
+    if (output == output_mode::ASCII)
     {
-        for (auto& cmd : ov7670_yuv)
-            i2c_write_register(i2c_instance, OV7670_ADDR, cmd.addr, cmd.value);
+        printf(">> roi %dx%d at %d,%d: %d SCCB transactions, %.2f ms\n", roi.width, roi.height, roi.x, roi.y,
+               sccb.get_transactions() - transactions, elapsed / 1000.0f);
     }
-    // TODO add other colorspace
+    return true;
 }
 
 
 void ov7670_init()
 {
-    // reset
-    i2c_write_register(i2c_instance, OV7670_ADDR, OV7670_REG_COM7, OV7670_COM7_RESET);
+    uint32_t start = time_us_32();
+    sccb.set_verify(SCCB_VERIFY);
 
-    // timing
-    i2c_write_register(i2c_instance, OV7670_ADDR, OV7670_REG_CLKRC, 1);     // CLK * 4
-    i2c_write_register(i2c_instance, OV7670_ADDR, OV7670_REG_DBLV, 1 << 6); // CLK / 4
+    // reset, the shadow forgets every register
+    sccb.write(OV7670_REG_COM7, OV7670_COM7_RESET);
 
-    // setup common register
-    for (auto& cmd : ov7670_init_cmd)
-    {
-        i2c_write_register(i2c_instance, OV7670_ADDR, cmd.addr, cmd.value);
-    }
-    
-    // setup image size
+    // timing, PLL x4, prescaler / 2, adjusted at runtime by the rate controller
+    rate.apply(RATE_DEFAULT_POINT);
+
+    // setup common register, with the registers of 80x60 YUV, merged at compile time
+    sccb.apply(ov7670_boot);
+    printf(">> ov7670 init: %d SCCB transactions, %.2f ms\n", sccb.get_transactions(), (time_us_32() - start) / 1000.0f);
+
+    // setup image size and format
     // using 80x60, 4.8kb per frame, using 115200bd(11.52kb/s)
-    set_size(OV7670_SIZE::OV7670_SIZE_DIV8);          
-    // setup image format
-    set_image_format(OV7670_COLOR::OV7670_COLOR_YUV); // 使用80x60分辨率的时候只能使用YUV或RGB，不能使用bayer raw
+    // 使用80x60分辨率的时候只能使用YUV或RGB，不能使用bayer raw
+    set_mode(OV7670_SIZE::OV7670_SIZE_DIV8, OV7670_COLOR::OV7670_COLOR_YUV);
 }
 
 
-// perform image capture, send to PC by UART
+// take the latest frame captured by core1, send to PC by UART
 void capture_frame()
 {
-    bool lframe_pin;
-    bool cframe_pin = gpio_get(GPIO_VSYNC);
+    poll_command();
+
+    frame_info frame;
+    if (!pipeline.acquire_frame(frame, CAPTURE_PERIOD_MS * 1000 + FRAME_TIMEOUT_US))
+    {
+        if (output == output_mode::ASCII)
+            printf(">> capture frame timeout\n");
+        return;
+    }
+
+    // core1 is capturing the next frame meanwhile
+    last_sequence = frame.sequence;
+    // a slow consumer shows up as overwritten frames, core0 holds one lease, core1 always finds a slot
+    if (rate.update(pipeline.get_captured_frames(), pipeline.get_capture_errors(), pipeline.get_overwritten()))
+    {
+        // frames in flight were captured around the clock change
+        format_valid_sequence = last_sequence + FRAME_STORE_SLOTS + 1;
+        if (output == output_mode::ASCII)
+            rate.print();
+    }
+    if (frame.sequence >= format_valid_sequence)
+    {
+        // one format test per frame, nothing per pixel
+        if (OV7670_LUMA_ONLY)
+            process_frame<pixel_format::Y8>(frame);
+        else if (sensor_format == pixel_format::RGB565)
+            process_frame<pixel_format::RGB565>(frame);
+        else
+            process_frame<pixel_format::YUV422>(frame);
+    }
+    pipeline.release_frame(frame);
+}
+
+template <pixel_format F>
+void process_frame(const frame_info& frame)
+{
+    switch (output)
+    {
+    case output_mode::ASCII:
+        printf(">> frame number: %d, sequence: %d...\n", ++frame_count, frame.sequence);
+        perform_capture_frame<F>(frame);
+        break;
+    case output_mode::BINARY_Y8:
+        send_binary_frame<F>(frame, pixel_format::Y8);
+        break;
+    case output_mode::BINARY_NATIVE:
+        send_binary_frame<F>(frame, F);
+        break;
+    case output_mode::BINARY_RGB565:
+        send_binary_frame<F>(frame, pixel_format::RGB565);
+        break;
+    case output_mode::BINARY_DELTA_Y8:
+        send_binary_frame<F>(frame, pixel_format::Y8, frame_encoding::DELTA_RLE);
+        break;
+    case output_mode::BINARY_QOI:
+        // QOI works on 2 byte pixels, luma only frames go out as grey RGB565
+        send_binary_frame<F>(frame, F == pixel_format::Y8 ? pixel_format::RGB565 : F, frame_encoding::QOI);
+        break;
+    case output_mode::BINARY_EDGES:
+        send_vision_frame<F>(frame, false);
+        break;
+    case output_mode::BINARY_BLOBS:
+        send_vision_frame<F>(frame, true);
+        break;
+    case output_mode::BINARY_MOTION:
+        send_motion_frame<F>(frame);
+        break;
+    case output_mode::BINARY_THUMBNAIL:
+        send_thumbnail_frame<F>(frame);
+        break;
+    }
+}
 
-    while(1)
+// image size 80x60
+template <pixel_format F>
+void perform_capture_frame(const frame_info& frame)
+{
+    // luma plane by the kernel of the sensor format, then luma to ascii char image
+    perf_span convert{perf_stage::CONVERT};
+    // the region of interest only
+    const uint8_t* luma = luma_plane<F>(frame);
+    uint8_t curve[256];
+    build_tone_curve(*frame.stats, contrast, curve);
+    contrast_lut.build(curve);
+    size_t len = render_ascii(luma, frame.width, frame.height, frame.width, 1, ascii_image, contrast_lut);
+
+    // the smaller sizes from the same lines, the oled image with the contrast of the ascii image
+    pyramid.begin(frame.width, frame.height, curve);
+    pyramid.add_plane(luma);
+    convert.stop();
+
+    perf_span transmit{perf_stage::TRANSMIT};
+    fwrite(ascii_image, 1, len, stdout); // 4.8Kb
+    transmit.stop();
+    printf(">> capture frame finished, capture time: %dus, %.1f fps\n", camera.get_capture_time_us(), camera.get_fps());
+    printf(">> dropped frames: %d, overwritten (backpressure): %d, consumer waits: %d, buffer starvation: %d\n",
+           pipeline.get_dropped_frames(), pipeline.get_overwritten(), pipeline.get_consumer_waits(), pipeline.get_buffer_starvation());
+    printf(">> luma mean: %d, min: %d, max: %d, p1: %d, p99: %d\n", frame.stats->mean(), frame.stats->min, frame.stats->max,
+           frame.stats->percentile(STRETCH_LOW_PER_MILLE), frame.stats->percentile(STRETCH_HIGH_PER_MILLE));
+
+    // core1 idle since the last report
+    static uint32_t last_idle_us = 0;
+    static uint32_t last_report_us = 0;
+    uint32_t idle_us = scheduler.get_idle_us();
+    uint32_t now = time_us_32();
+    if (last_report_us)
     {
-        lframe_pin = cframe_pin;
-        // sleep_us(10);
-        cframe_pin = gpio_get(GPIO_VSYNC);
-        if (lframe_pin && !cframe_pin)  // falling edge trigger
+        printf(">> core1 idle: %.1f%%\n", (idle_us - last_idle_us) * 100.0f / (now - last_report_us));
+    }
+    last_idle_us = idle_us;
+    last_report_us = now;
+}
+
+template <pixel_format F>
+const uint8_t* luma_plane(const frame_info& frame)
+{
+    if constexpr (F == pixel_format::Y8)
+    {
+        return frame.data;      // no copy
+    }
+    else
+    {
+        pixel_kernels<F>::to_luma(frame.data, luma_image, frame.width * frame.height);
+        return luma_image;
+    }
+}
+
+bool capture_frame_callback(repeating_timer_t* rt)
+{
+    scheduler.request_frames(1);
+    return true;
+}
+
+
+void schedule_benchmark()
+{
+    struct rate_entry
+    {
+        const char* name;
+        capture_request mode;
+        uint32_t every;
+    };
+    const rate_entry rates[] = {
+        {"every frame", capture_request::CONTINUOUS, 1},
+        {"1 of 2", capture_request::EVERY_NTH, 2},
+        {"1 of 4", capture_request::EVERY_NTH, 4},
+        {"1 of 8", capture_request::EVERY_NTH, 8},
+        {"on demand, 2/s", capture_request::ON_DEMAND, 0},
+    };
+    const uint32_t duration_us = 3000000;
+
+    for (auto& r : rates)
+    {
+        if (r.mode == capture_request::CONTINUOUS)
+            scheduler.set_continuous();
+        else if (r.mode == capture_request::EVERY_NTH)
+            scheduler.set_every_nth(r.every);
+        else
+        {
+            scheduler.set_on_demand();
+            add_repeating_timer_ms(500, capture_frame_callback, nullptr, &capture_timer);
+        }
+
+        // core0 only takes and gives back the frames, its time waiting is idle too
+        uint32_t frames = 0;
+        uint32_t wait_us = 0;
+        uint32_t vsync = scheduler.get_vsync_count();
+        uint32_t idle_us = scheduler.get_idle_us();
+        uint32_t start = time_us_32();
+        while (time_us_32() - start < duration_us)
+        {
+            frame_info frame;
+            uint32_t wait_start = time_us_32();
+            bool ok = pipeline.acquire_frame(frame, duration_us - (wait_start - start));
+            wait_us += time_us_32() - wait_start;
+            if (ok)
+            {
+                ++frames;
+                pipeline.release_frame(frame);
+            }
+        }
+        uint32_t elapsed = time_us_32() - start;
+        idle_us = scheduler.get_idle_us() - idle_us;
+        vsync = scheduler.get_vsync_count() - vsync;
+
+        if (r.mode == capture_request::ON_DEMAND)
         {
-            printf(">> frame number: %d...\n", ++frame_count);
-            perform_capture_frame();    // capture one frame
-            break;
+            cancel_repeating_timer(&capture_timer);
         }
+        printf(">> capture %s: %.1f fps of %.1f sensor fps, core1 idle %.1f%%, core0 idle %.1f%%\n", r.name,
+               frames * 1000000.0f / elapsed, vsync * 1000000.0f / elapsed, idle_us * 100.0f / elapsed, wait_us * 100.0f / elapsed);
     }
+    scheduler.set_continuous();
 }
 
-// image size 80x60
-void perform_capture_frame()
+
+bool stream_frame(OV7670_SIZE size, line_sink_t sink)
 {
-    uint32_t line_count = 0;
-    uint32_t point_count = 0;
-    
-    bool lline_pin;
-    bool cline_pin = gpio_get(GPIO_HREF);
-    bool lpoint_pin;
-    bool cpoint_pin;
+    const size_t width = ov7670_width(size);
+    const size_t height = ov7670_height(size);
 
-    uint32_t start;
-    uint32_t end1;
-    uint32_t end2;
-    uint32_t end3;
-    uint32_t end4;
+    if (!camera.start_stream(&line_ring[0][0], width * FRAME_PIXEL_BYTES, LINE_RING_LINES, height))
+    {
+        return false;
+    }
+
+    // the sink must return before the dma comes back to the same ring slot
+    for (size_t i = 0; i < height; i++)
+    {
+        const uint8_t* line = camera.get_line(FRAME_TIMEOUT_US);
+        if (!line)
+        {
+            return false;
+        }
+        sink(line, i, width, height);
+        camera.release_line();
+    }
+    return camera.wait_for_frame(FRAME_TIMEOUT_US);
+}
+
+
+void null_sink(const uint8_t* line, size_t line_index, size_t width, size_t height)
+{
+}
+
+
+void ascii_sink(const uint8_t* line, size_t line_index, size_t width, size_t height)
+{
+    // keep 60 lines and 80 columns whatever the size
+    size_t step = height > 60 ? height / 60 : 1;
+    if (line_index % step)
+    {
+        return;
+    }
+
+    char ascii_line[81];
+    for (size_t j = 0; j < 80; j++)
+    {
+        ascii_line[j] = ASCII_LUT.entry[line[FRAME_PIXEL_BYTES * (j * width / 80)]];
+    }
+    ascii_line[80] = '\n';
+    fwrite(ascii_line, 1, sizeof(ascii_line), stdout);
+}
 
-    uint8_t data;
 
-    // line loop
-    while (!gpio_get(GPIO_VSYNC))                   // make sure the line signal still stay in the current frame
+qoi_encoder stream_qoi;
+uint32_t qoi_stream_bytes = 0;
+
+void qoi_sink(const uint8_t* line, size_t line_index, size_t width, size_t height)
+{
+    static uint8_t out[qoi_max_encoded_size(640 * FRAME_PIXEL_BYTES)];
+    if (line_index == 0)
     {
-        lline_pin = cline_pin;
-        cline_pin = gpio_get(GPIO_HREF);
+        stream_qoi.begin_frame();
+    }
+    qoi_stream_bytes += stream_qoi.encode_line(line, width * FRAME_PIXEL_BYTES, out);
+}
 
-        if (!lline_pin && cline_pin)                // raising edge trigger
+
+void stream_benchmark()
+{
+    struct sink_entry
+    {
+        const char* name;
+        line_sink_t sink;
+    };
+    const sink_entry sinks[] = {{"null", null_sink}, {"ascii", ascii_sink}, {"qoi", qoi_sink}};
+    const uint32_t frames = 5;
+
+    for (auto& s : sinks)
+    {
+        uint best_width = 0;
+        uint best_height = 0;
+        float best_fps = 0;
+
+        // from the smallest size to the largest one
+        for (int i = int(OV7670_SIZE::OV7670_SIZE_DIV16); i >= int(OV7670_SIZE::OV7670_SIZE_DIV1); i--)
         {
-            if(++line_count <= 60)
+            auto size = OV7670_SIZE(i);
+            set_mode(size, OV7670_COLOR::OV7670_COLOR_YUV);     // only the scaling registers change
+            sleep_ms(300);  // let the sensor settle
+
+            uint32_t overrun = camera.get_overrun_lines();
+            uint32_t finished = 0;
+            qoi_stream_bytes = 0;
+            uint32_t start = time_us_32();
+            for (uint32_t n = 0; n < frames; n++)
             {
-                cpoint_pin = gpio_get(GPIO_PCLK);
-                // point loop
-                while (gpio_get(GPIO_HREF))
-                {
-                    lpoint_pin = cpoint_pin;
-                    cpoint_pin = gpio_get(GPIO_PCLK);
-                    
-                    if (!lpoint_pin && cpoint_pin)  // raising edge trigger
-                    {
-                        if (++point_count <= 160)
-                        {
-                            data = (GPIO_DATA_MASK & gpio_get_all()) >> GPIO_D0;    // convert D0-D7 to byte
-                            yuv_image[line_count - 1][point_count - 1] = data;
-                        } 
-                        else 
-                        {
-                            printf("point overflow\n");
-                            break;
-                        }
-                    }            
-                }
-                point_count = 0;
-            } 
-            else 
+                finished += stream_frame(size, s.sink);
+            }
+            float fps = finished * 1000000.0f / (time_us_32() - start);
+            overrun = camera.get_overrun_lines() - overrun;
+
+            printf(">> stream %dx%d to %s: %.1f fps, %d/%d frames, overrun lines: %d\n",
+                   ov7670_width(size), ov7670_height(size), s.name, fps, finished, frames, overrun);
+            if (s.sink == qoi_sink && qoi_stream_bytes)
+            {
+                printf(">> qoi %d bytes/frame, ratio %.2f\n", qoi_stream_bytes / frames,
+                       float(ov7670_width(size) * ov7670_height(size) * FRAME_PIXEL_BYTES * frames) / qoi_stream_bytes);
+            }
+            if (finished == frames && overrun == 0)
             {
-                printf("line overflow\n");
-                break;
-            }  
+                best_width = ov7670_width(size);
+                best_height = ov7670_height(size);
+                best_fps = fps;
+            }
         }
+        printf(">> sink %s: max sustained resolution %dx%d, %.1f fps\n", s.name, best_width, best_height, best_fps);
     }
+}
 
 
-    std::string ascii_str_image;
-    start = time_us_32();
-    // convert YUV data to ascii char image
-    for (size_t i = 0; i < 60; i++)
+void poll_command()
+{
+    int c = getchar_timeout_us(0);
+    switch (c)
     {
-        for (size_t j = 0; j < 80; j++)
+    case 'a':
+        set_output_mode(output_mode::ASCII);
+        break;
+    case 'y':
+        set_output_mode(output_mode::BINARY_Y8);
+        break;
+    case 'u':
+        set_output_mode(output_mode::BINARY_NATIVE);
+        break;
+    case 'c':
+        set_output_mode(output_mode::BINARY_RGB565);
+        break;
+    case 'q':
+        set_output_mode(output_mode::BINARY_QOI);
+        break;
+    case 'd':
+        set_output_mode(output_mode::BINARY_DELTA_Y8);
+        encoder.request_keyframe();
+        break;
+    case 'k':
+        encoder.request_keyframe();
+        break;
+    case 'x':
+        set_output_mode(output_mode::BINARY_EDGES);
+        break;
+    case 'b':
+        set_output_mode(output_mode::BINARY_BLOBS);
+        break;
+    case 'm':
+        set_output_mode(output_mode::BINARY_MOTION);
+        break;
+    case 't':
+        set_output_mode(output_mode::BINARY_THUMBNAIL);
+        break;
+    case 'Y':
+        set_sensor_format(pixel_format::YUV422);
+        break;
+    case 'R':
+        set_sensor_format(pixel_format::RGB565);
+        break;
+    case 'w':
+    {
+        // x, y, width, height in pixels of the 80x60 frame
+        int v[4];
+        bool received = true;
+        for (int& b : v)
+        {
+            b = getchar_timeout_us(100000);
+            received &= b >= 0;
+        }
+        if (!received || !set_roi({uint16_t(v[0]), uint16_t(v[1]), uint16_t(v[2]), uint16_t(v[3])}))
         {
-            ascii_char_image[i][j] = charmap[70 - uint32_t(yuv_image[i][2 * j] / 3.7)];
+            if (output == output_mode::ASCII)
+                printf(">> invalid roi\n");
         }
-        ascii_str_image += (std::string(ascii_char_image[i]) + "\n"); 
+        break;
+    }
+    case 'W':
+        set_roi(ov7670_full_roi(current_size));
+        break;
+    case 'o':
+        rate.print();
+        break;
+    case 'p':
+        perf_print();
+        break;
+    case 'P':
+        perf_reset();
+        break;
+    case 'l':
+        contrast = contrast_mode::LINEAR;
+        break;
+    case 's':
+        contrast = contrast_mode::STRETCH;
+        break;
+    case 'e':
+        contrast = contrast_mode::EQUALIZE;
+        break;
+    case '0':
+        scheduler.set_continuous();
+        break;
+    case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9':
+        scheduler.set_every_nth(c - '0');
+        break;
+    case 'f':
+        scheduler.set_on_demand();
+        scheduler.request_frames(1);
+        break;
+    default:
+        break;
     }
-    end1 = time_us_32();
-    printf(ascii_str_image.c_str()); // 1.2Kb
-    end2 = time_us_32();
-    printf(">> image convert time: %dus, image transmit time: %dus\n", end1 - start, end2 - end1);
-    printf(">> capture frame finished, get %d lines\n", line_count);
 }
 
-bool capture_frame_callback(repeating_timer_t* rt)
+
+void set_output_mode(output_mode mode)
 {
-    capture_frame();
-    return true;
+    // the background is learned again, the first frame goes out as a keyframe
+    if (mode == output_mode::BINARY_MOTION && output != mode)
+    {
+        motion.reset();
+        motion_keyframe_us = time_us_32() - MOTION_KEYFRAME_MS * 1000;
+    }
+    output = mode;
+    // binary frames go out byte by byte, no "\n" -> "\r\n"
+    stdio_set_translate_crlf(&stdio_usb, mode == output_mode::ASCII);
+}
+
+
+void set_sensor_format(pixel_format format)
+{
+    // the luma only capture keeps the Y bytes of YUV422
+    if (format == sensor_format || OV7670_LUMA_ONLY)
+    {
+        return;
+    }
+
+    // only COM7, COM15 and RGB444 change, see sccb_shadow.h
+    set_image_format(format == pixel_format::RGB565 ? OV7670_COLOR::OV7670_COLOR_RGB : OV7670_COLOR::OV7670_COLOR_YUV);
+    sensor_format = format;
+    pipeline.set_pixel_format(format);
+    // every buffer in flight may hold the old format, plus the frame being captured during the switch
+    format_valid_sequence = last_sequence + FRAME_STORE_SLOTS + 1;
+    encoder.request_keyframe();
+}
+
+
+template <pixel_format F>
+void send_binary_frame(const frame_info& frame, pixel_format format, frame_encoding encoding)
+{
+    const uint8_t* payload = frame.data;
+    size_t len = frame.len;
+
+    perf_span convert{perf_stage::CONVERT};
+    const uint8_t* luma = nullptr;
+    if (format == pixel_format::Y8)
+    {
+        luma = luma_plane<F>(frame);
+        payload = luma;
+        len = frame.width * frame.height;
+    }
+    else if (format == pixel_format::RGB565 && F != pixel_format::RGB565)
+    {
+        pixel_kernels<F>::to_rgb565(frame.data, rgb565_image, frame.width * frame.height);
+        payload = rgb565_image;
+        len = size_t(frame.width) * frame.height * 2;     // a Y8 capture is half the size of its RGB565 plane
+    }
+    convert.stop();
+
+    // delta encoding and framing
+    perf_span encode{perf_stage::ENCODE};
+    if (encoding == frame_encoding::DELTA_RLE)
+    {
+        len = encoder.encode(luma, encoded_image);
+        payload = encoded_image;
+    }
+    else if (encoding == frame_encoding::QOI)
+    {
+        size_t qoi_len = qoi_encode(payload, frame.width * 2, frame.height, encoded_image);
+        if (qoi_len < len)
+        {
+            len = qoi_len;
+            payload = encoded_image;
+        }
+        else
+        {
+            encoding = frame_encoding::RAW;     // noise, the raw frame is smaller
+        }
+    }
+
+    encode.stop();
+    write_frame(frame, format, encoding, payload, len);
+}
+
+
+template <pixel_format F>
+void send_vision_frame(const frame_info& frame, bool blobs)
+{
+    perf_span convert{perf_stage::CONVERT};
+    const uint8_t* luma = luma_plane<F>(frame);
+    size_t len = 0;
+    if (blobs)
+    {
+        // the level comes from the histogram built during the capture, no pass over the frame
+        blob found[MAX_BLOBS];
+        size_t count = find_blobs(luma, frame.width, frame.height, otsu_level(*frame.stats), vision_row, finder,
+                                  found, MAX_BLOBS, 2);
+        for (size_t i = 0; i < count; i++)
+        {
+            const blob& b = found[i];
+            blob_record r = {b.x0, b.y0, b.x1, b.y1, uint16_t(b.centroid_x16()), uint16_t(b.centroid_y16()), b.area};
+            memcpy(encoded_image + i * sizeof(r), &r, sizeof(r));
+        }
+        len = count * sizeof(blob_record);
+    }
+    else
+    {
+        // edges straight into the payload buffer, it holds a luma plane
+        apply_row_kernel(sobel_row, luma, encoded_image, frame.width, frame.height);
+        len = frame.width * frame.height;
+    }
+    convert.stop();
+
+    write_frame(frame, pixel_format::Y8, blobs ? frame_encoding::BLOBS : frame_encoding::RAW, encoded_image, len);
+}
+
+
+template <pixel_format F>
+void send_motion_frame(const frame_info& frame)
+{
+    perf_span convert{perf_stage::CONVERT};
+    const uint8_t* luma = luma_plane<F>(frame);
+    motion_record event;
+    bool moved = motion.update(luma, frame.width, frame.height, event);
+    convert.stop();
+
+    if (moved)
+    {
+        write_frame(frame, pixel_format::Y8, frame_encoding::MOTION, reinterpret_cast<const uint8_t*>(&event), sizeof(event));
+    }
+    if (moved || frame.capture_us - motion_keyframe_us >= MOTION_KEYFRAME_MS * 1000)
+    {
+        motion_keyframe_us = frame.capture_us;
+        write_frame(frame, pixel_format::Y8, frame_encoding::RAW, luma, size_t(frame.width) * frame.height);
+    }
 }
 
+
+template <pixel_format F>
+void send_thumbnail_frame(const frame_info& frame)
+{
+    perf_span convert{perf_stage::CONVERT};
+    pyramid.begin(frame.width, frame.height);
+    pyramid.add_plane(luma_plane<F>(frame));
+    convert.stop();
+
+    pyramid_level half = pyramid.get_half();
+    frame_info thumbnail = frame;
+    thumbnail.width = half.width;
+    thumbnail.height = half.height;
+    write_frame(thumbnail, pixel_format::Y8, frame_encoding::RAW, half.data, half.width * half.height);
+}
+
+
+void write_frame(const frame_info& frame, pixel_format format, frame_encoding encoding, const uint8_t* payload, size_t len)
+{
+    // header and crc count as sending, ENCODE is only the delta or qoi work of the caller
+    perf_span transmit{perf_stage::TRANSMIT};
+    frame_header header = {};
+    header.magic = FRAME_MAGIC;
+    header.sequence = frame.sequence;
+    header.capture_us = frame.capture_us;
+    header.send_us = time_us_32();
+    header.width = frame.width;
+    header.height = frame.height;
+    header.format = uint8_t(format);
+    header.encoding = uint8_t(encoding);
+    header.payload_len = len;
+    header.crc = frame_crc(header, payload);
+    fwrite(&header, 1, sizeof(header), stdout);
+    fwrite(payload, 1, len, stdout);
+    fflush(stdout);
+}
+
+
+void convert_benchmark()
+{
+    typedef void (*kernel_t)(const uint8_t* src, uint8_t* dst, size_t pixels);
+    struct kernel_entry
+    {
+        const char* name;
+        kernel_t swar;
+        kernel_t ref;
+        uint8_t* out;
+    };
+    const kernel_entry kernels[] = {
+        {"yuv422 -> luma", yuv422_to_luma, yuv422_to_luma_ref, luma_image},
+        {"rgb565 -> luma", rgb565_to_luma, rgb565_to_luma_ref, luma_image},
+        {"yuv422 -> rgb565", yuv422_to_rgb565, yuv422_to_rgb565_ref, rgb565_image},
+    };
+    const uint32_t pixels = FRAME_WIDTH * FRAME_HEIGHT;
+
+    // the kernels read 2 bytes per pixel
+    if (OV7670_LUMA_ONLY)
+    {
+        printf(">> convert benchmark: luma only capture, nothing to convert\n");
+        return;
+    }
+
+    // any frame is good for timing, the kernels do not branch on pixel values
+    frame_info frame;
+    if (!pipeline.acquire_frame(frame))
+    {
+        printf(">> convert benchmark: no frame\n");
+        return;
+    }
+
+    // SysTick counts core cycles down from 2^24, one frame takes far less
+    systick_hw->rvr = 0x00ffffff;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5;     // processor clock, enabled, no interrupt
+    for (auto& k : kernels)
+    {
+        kernel_t fn[2] = {k.swar, k.ref};
+        uint32_t cycles[2];
+        for (int n = 0; n < 2; n++)
+        {
+            uint32_t start = systick_hw->cvr;
+            fn[n](frame.data, k.out, pixels);
+            cycles[n] = (start - systick_hw->cvr) & 0x00ffffff;
+        }
+        printf(">> %s: swar %d cycles (%d.%02d/pixel), reference %d cycles (%d.%02d/pixel)\n", k.name,
+               cycles[0], cycles[0] / pixels, cycles[0] * 100 / pixels % 100,
+               cycles[1], cycles[1] / pixels, cycles[1] * 100 / pixels % 100);
+    }
+
+    // lossless codec, worth it when the encode time is below the transmit time it saves
+    uint32_t start = systick_hw->cvr;
+    size_t len = qoi_encode(frame.data, frame.width * 2, frame.height, encoded_image);
+    uint32_t cycles = (start - systick_hw->cvr) & 0x00ffffff;
+    uint32_t encode_us = cycles / (clock_get_hz(clk_sys) / 1000000);
+    uint32_t saved_us = uint32_t((frame.len - std::min(len, frame.len)) * 1000000ull / 11520);
+    printf(">> qoi encode: %d cycles (%dus), %d -> %d bytes, saves %dus at 115200 baud\n",
+           cycles, encode_us, frame.len, len, saved_us);
+
+    // the detector and the pyramid branch on pixel values, the kernel rows above left luma_image
+    // as YUV bytes read as RGB565, convert the frame again as it was captured
+    (sensor_format == pixel_format::RGB565 ? rgb565_to_luma : yuv422_to_luma)(frame.data, luma_image, pixels);
+
+    // motion detector, the first frame only fills the background, the second one is compared
+    motion_record event;
+    motion.reset();
+    motion.update(luma_image, frame.width, frame.height, event);
+    start = systick_hw->cvr;
+    motion.update(luma_image, frame.width, frame.height, event);
+    cycles = (start - systick_hw->cvr) & 0x00ffffff;
+    printf(">> motion detector: %d cycles (%d.%02d/pixel)\n", cycles, cycles / pixels, cycles * 100 / pixels % 100);
+    motion.reset();
+
+    // pyramid against a capture at every size: a mode switch, then the frames in flight are dropped
+    start = systick_hw->cvr;
+    pyramid.begin(frame.width, frame.height);
+    pyramid.add_plane(luma_image);
+    cycles = (start - systick_hw->cvr) & 0x00ffffff;
+    uint32_t frame_us = camera.get_fps() > 0 ? uint32_t(1000000 / camera.get_fps()) : 0;
+    printf(">> pyramid 1/2, 1/4, oled: %d cycles (%dus, %d.%02d/pixel), a capture per size costs %d frames (%dus) and a mode switch\n",
+           cycles, cycles / (clock_get_hz(clk_sys) / 1000000), cycles / pixels, cycles * 100 / pixels % 100,
+           FRAME_STORE_SLOTS + 2, (FRAME_STORE_SLOTS + 2) * frame_us);
+
+    systick_hw->csr = 0;
+    pipeline.release_frame(frame);
+}
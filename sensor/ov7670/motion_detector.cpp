@@ -0,0 +1,156 @@
+#include "motion_detector.h"
+
+static const uint32_t MOTION_BLOCK_SHIFT = __builtin_ctz(MOTION_BLOCK);
+static const int32_t MOTION_MAX_LEVEL = 255 * 16;
+static const int32_t MOTION_MEDIAN_RANGE = 127;     // luma, larger differences count as the largest
+
+bool motion_detector::update(const uint8_t* luma, size_t width, size_t height, motion_record& event)
+{
+    uint32_t cols = (width + MOTION_BLOCK - 1) >> MOTION_BLOCK_SHIFT;
+    uint32_t rows = (height + MOTION_BLOCK - 1) >> MOTION_BLOCK_SHIFT;
+    if (cols == 0 || rows == 0 || cols > MOTION_MAX_COLS || rows > MOTION_MAX_ROWS)
+    {
+        return false;
+    }
+    if (width != width_ || height != height_)
+    {
+        width_ = width;
+        height_ = height;
+        cols_ = cols;
+        rows_ = rows;
+        frames_ = 0;
+    }
+
+    sum_blocks(luma, width, height);
+    const uint32_t blocks = cols_ * rows_;
+    if (frames_++ == 0)
+    {
+        for (uint32_t i = 0; i < blocks; i++)
+        {
+            background_[i] = mean_[i];
+            deviation_[i] = 0;
+        }
+        return false;
+    }
+
+    const bool warm = frames_ > MOTION_WARMUP_FRAMES;
+    const int32_t light = median_difference();
+    uint32_t moving = 0;
+    uint32_t peak = 0;
+    uint32_t total = 0;
+    uint32_t c0 = cols_, r0 = rows_, c1 = 0, r1 = 0;
+    for (uint32_t r = 0, i = 0; r < rows_; r++)
+    {
+        for (uint32_t c = 0; c < cols_; c++, i++)
+        {
+            int32_t diff = int32_t(mean_[i]) - background_[i] - light;
+            uint32_t abs_diff = diff < 0 ? -diff : diff;
+            uint32_t threshold = MOTION_NOISE_FACTOR * deviation_[i];
+            threshold = threshold > MOTION_MIN_DIFF * 16 ? threshold : MOTION_MIN_DIFF * 16;
+            bool block_moving = warm && abs_diff > threshold;
+
+            // the whole scene follows the light, a moving block fades in slowly
+            int32_t bg = background_[i] + light + (diff >> (block_moving ? MOTION_MOVING_SHIFT : MOTION_STILL_SHIFT));
+            background_[i] = bg < 0 ? 0 : (bg > MOTION_MAX_LEVEL ? MOTION_MAX_LEVEL : bg);
+            if (!block_moving)
+            {
+                // a moving object is no noise
+                deviation_[i] += (int32_t(abs_diff) - deviation_[i]) >> MOTION_DEVIATION_SHIFT;
+                continue;
+            }
+
+            ++moving;
+            total += abs_diff;
+            peak = abs_diff > peak ? abs_diff : peak;
+            c0 = c < c0 ? c : c0;
+            c1 = c > c1 ? c : c1;
+            r0 = r < r0 ? r : r0;
+            r1 = r > r1 ? r : r1;
+        }
+    }
+
+    if (!moving)
+    {
+        return false;
+    }
+
+    ++events_;
+    uint32_t x1 = (c1 + 1) << MOTION_BLOCK_SHIFT;
+    uint32_t y1 = (r1 + 1) << MOTION_BLOCK_SHIFT;
+    int32_t light_luma = light / 16;
+    event.x0 = c0 << MOTION_BLOCK_SHIFT;
+    event.y0 = r0 << MOTION_BLOCK_SHIFT;
+    event.x1 = (x1 < width ? x1 : width) - 1;
+    event.y1 = (y1 < height ? y1 : height) - 1;
+    event.blocks = moving;
+    event.grid_blocks = blocks;
+    event.peak = peak / 16 > 255 ? 255 : peak / 16;
+    event.mean = total / moving / 16;
+    event.light = light_luma < -128 ? -128 : (light_luma > 127 ? 127 : light_luma);
+    event.reserved = 0;
+    return true;
+}
+
+void motion_detector::sum_blocks(const uint8_t* luma, size_t width, size_t height)
+{
+    uint32_t sums[MOTION_MAX_COLS];
+    for (uint32_t r = 0; r < rows_; r++)
+    {
+        for (uint32_t c = 0; c < cols_; c++)
+        {
+            sums[c] = 0;
+        }
+
+        // a band of block rows, the last band and the last column may be cut
+        size_t y0 = r << MOTION_BLOCK_SHIFT;
+        size_t y1 = y0 + MOTION_BLOCK < height ? y0 + MOTION_BLOCK : height;
+        for (size_t y = y0; y < y1; y++)
+        {
+            const uint8_t* p = luma + y * width;
+            size_t x = 0;
+            for (uint32_t c = 0; c < cols_; c++)
+            {
+                size_t end = x + MOTION_BLOCK < width ? x + MOTION_BLOCK : width;
+                uint32_t sum = 0;
+                for (; x < end; x++)
+                {
+                    sum += p[x];
+                }
+                sums[c] += sum;
+            }
+        }
+
+        for (uint32_t c = 0; c < cols_; c++)
+        {
+            size_t x0 = c << MOTION_BLOCK_SHIFT;
+            size_t x1 = x0 + MOTION_BLOCK < width ? x0 + MOTION_BLOCK : width;
+            uint32_t pixels = uint32_t((x1 - x0) * (y1 - y0));
+            mean_[r * cols_ + c] = pixels == MOTION_BLOCK * MOTION_BLOCK ? (sums[c] * 16) >> (2 * MOTION_BLOCK_SHIFT)
+                                                                          : sums[c] * 16 / pixels;
+        }
+    }
+}
+
+int32_t motion_detector::median_difference() const
+{
+    // counting sort of the block differences, whole luma steps
+    uint16_t bins[2 * MOTION_MEDIAN_RANGE + 1] = {};
+    const uint32_t blocks = cols_ * rows_;
+    for (uint32_t i = 0; i < blocks; i++)
+    {
+        int32_t diff = (int32_t(mean_[i]) - background_[i]) / 16;
+        diff = diff < -MOTION_MEDIAN_RANGE ? -MOTION_MEDIAN_RANGE : (diff > MOTION_MEDIAN_RANGE ? MOTION_MEDIAN_RANGE : diff);
+        ++bins[diff + MOTION_MEDIAN_RANGE];
+    }
+
+    uint32_t seen = 0;
+    for (int32_t d = 0; d <= 2 * MOTION_MEDIAN_RANGE; d++)
+    {
+        seen += bins[d];
+        if (seen * 2 > blocks)
+        {
+            return (d - MOTION_MEDIAN_RANGE) * 16;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef MOTION_DETECTOR_H_
+#define MOTION_DETECTOR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "frame_protocol.h"
+
+/*
+motion detection on the luma plane against an adaptive background
+the frame is cut into MOTION_BLOCK x MOTION_BLOCK blocks, only the block means are compared,
+one add per pixel, everything else runs per block. no float, no SDK dependency, the PC side tools (host/) build it too
+
+per block the model keeps the background mean and the mean absolute deviation of the frames from it (noise),
+both in 1/16 luma, following the scene with exponential moving averages:
+    a block moves when its mean is further than max(MOTION_MIN_DIFF, MOTION_NOISE_FACTOR * deviation) from the background
+    still blocks follow the scene quickly, moving blocks slowly, an object that stops becomes background
+the median difference of all blocks is taken out first, a change of exposure or light moves every block and is no motion
+*/
+
+const uint32_t MOTION_BLOCK = 8;                // pixels, a power of 2
+const uint32_t MOTION_MAX_COLS = 40;            // 320x240 at most
+const uint32_t MOTION_MAX_ROWS = 30;
+const uint32_t MOTION_MIN_DIFF = 6;             // luma, below this a block never moves
+const uint32_t MOTION_NOISE_FACTOR = 4;         // deviations, about 3 sigma
+const uint32_t MOTION_STILL_SHIFT = 3;          // background of a still block moves 1/8 of the way per frame
+const uint32_t MOTION_MOVING_SHIFT = 7;         // 1/128 for a moving block, a stopped object fades in
+const uint32_t MOTION_DEVIATION_SHIFT = 4;
+const uint32_t MOTION_WARMUP_FRAMES = 8;        // no events until the noise is learned
+
+
+class motion_detector
+{
+public:
+    /*
+    compare a frame with the background and update the background
+    a new frame size starts the model again
+    @param luma width * height, width and height at most MOTION_MAX_COLS / MOTION_MAX_ROWS blocks
+    @return true if motion is seen, event is filled, the frame header carries the timestamp
+    */
+    bool update(const uint8_t* luma, size_t width, size_t height, motion_record& event);
+
+    // forget the background, the next frame is the first one
+    void reset() { frames_ = 0; }
+
+    // frames with motion, frames compared
+    uint32_t get_events() const { return events_; }
+    uint32_t get_frames() const { return frames_; }
+
+private:
+    void sum_blocks(const uint8_t* luma, size_t width, size_t height);    // block means to mean_
+    int32_t median_difference() const;
+
+private:
+    uint16_t background_[MOTION_MAX_ROWS * MOTION_MAX_COLS];   // 1/16 luma
+    uint16_t deviation_[MOTION_MAX_ROWS * MOTION_MAX_COLS];
+    uint16_t mean_[MOTION_MAX_ROWS * MOTION_MAX_COLS];         // of the frame being compared
+    uint32_t cols_ = 0;
+    uint32_t rows_ = 0;
+    size_t width_ = 0;
+    size_t height_ = 0;
+    uint32_t frames_ = 0;
+    uint32_t events_ = 0;
+};
+
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef OV7670_WINDOW_H_
+#define OV7670_WINDOW_H_
+
+#include "reg_config.h"
+
+/*
+hardware region of interest
+the sensor only outputs the pixels inside the window set by HSTART/HSTOP/HREF and VSTART/VSTOP/VREF,
+so HREF is shorter and there are fewer lines, capture, convert and transmit work on the window only.
+
+window registers count VGA pixels, the region is given in output pixels of the current size
+and scaled by the down sampling of the size.
+window origins were determined empirically by the Adafruit OV7670 driver
+*/
+
+// region of interest in output pixels, width must be even (4 bytes per 2 pixels)
+struct frame_roi
+{
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+};
+
+struct ov7670_window_origin
+{
+    uint16_t vstart;
+    uint16_t hstart;
+    uint8_t edge_offset;
+};
+
+// indexed by OV7670_SIZE
+static const ov7670_window_origin ov7670_window_origins[] =
+{
+    {9, 162, 2},    // 640 x 480
+    {10, 174, 4},   // 320 x 240
+    {11, 186, 2},   // 160 x 120
+    {12, 210, 0},   // 80 x 60
+    {15, 252, 3},   // 40 x 30
+};
+
+const uint16_t OV7670_HSTOP_WRAP = 784;    // horizontal counter wraps, including blanking
+
+inline constexpr frame_roi ov7670_full_roi(OV7670_SIZE size)
+{
+    return {0, 0, uint16_t(ov7670_width(size)), uint16_t(ov7670_height(size))};
+}
+
+inline constexpr bool ov7670_roi_valid(OV7670_SIZE size, const frame_roi& roi)
+{
+    return roi.width && roi.height && !(roi.width % 2) &&
+           roi.x + roi.width <= ov7670_width(size) && roi.y + roi.height <= ov7670_height(size);
+}
+
+/*
+window registers of a region
+@return false if the region is not inside the frame of the size
+*/
+inline bool ov7670_window_commands(OV7670_SIZE size, const frame_roi& roi, i2c_command (&cmds)[6])
+{
+    if (!ov7670_roi_valid(size, roi))
+    {
+        return false;
+    }
+
+    const ov7670_window_origin& origin = ov7670_window_origins[static_cast<uint>(size)];
+    const uint scale = 1u << static_cast<uint>(size);
+    uint hstart = (origin.hstart + roi.x * scale) % OV7670_HSTOP_WRAP;
+    uint hstop = (hstart + roi.width * scale) % OV7670_HSTOP_WRAP;
+    uint vstart = origin.vstart + roi.y * scale;
+    uint vstop = vstart + roi.height * scale;
+
+    // 8 high bits in HSTART/HSTOP, 3 low bits in HREF, VSTART/VSTOP hold 8 high bits, 2 low bits in VREF
+    cmds[0] = {OV7670_REG_HSTART, uint8_t(hstart >> 3)};
+    cmds[1] = {OV7670_REG_HSTOP, uint8_t(hstop >> 3)};
+    cmds[2] = {OV7670_REG_HREF, uint8_t((origin.edge_offset << 6) | ((hstop & 0x07) << 3) | (hstart & 0x07))};
+    cmds[3] = {OV7670_REG_VSTART, uint8_t(vstart >> 2)};
+    cmds[4] = {OV7670_REG_VSTOP, uint8_t(vstop >> 2)};
+    cmds[5] = {OV7670_REG_VREF, uint8_t(((vstop & 0x03) << 2) | (vstart & 0x03))};
+    return true;
+}
+
+
+#endif
@@ -0,0 +1,112 @@
+#include "perf_stats.h"
+#include <stdio.h>
+
+void latency_histogram::add(uint32_t us)
+{
+    ++buckets_[bucket_index(us)];
+    ++count_;
+    if (us < min_)
+        min_ = us;
+    if (us > max_)
+        max_ = us;
+}
+
+void latency_histogram::reset()
+{
+    for (auto& b : buckets_)
+    {
+        b = 0;
+    }
+    count_ = 0;
+    min_ = UINT32_MAX;
+    max_ = 0;
+}
+
+uint32_t latency_histogram::percentile(uint32_t per_mille) const
+{
+    if (!count_)
+    {
+        return 0;
+    }
+
+    // rank of the wanted sample, 1 based
+    uint32_t rank = uint32_t((uint64_t(count_) * per_mille + 999) / 1000);
+    if (rank == 0)
+        rank = 1;
+
+    uint32_t seen = 0;
+    for (uint i = 0; i < BUCKETS; i++)
+    {
+        seen += buckets_[i];
+        if (seen >= rank)
+        {
+            uint32_t low = bucket_low(i);
+            uint32_t high = i + 1 < BUCKETS ? bucket_low(i + 1) - 1 : UINT32_MAX;
+            uint32_t mid = low + (high - low) / 2;
+            return mid < min_ ? min_ : (mid > max_ ? max_ : mid);
+        }
+    }
+    return max_;
+}
+
+// 0-15 exact, then 4 buckets per power of two
+uint latency_histogram::bucket_index(uint32_t us)
+{
+    if (us < 16)
+    {
+        return us;
+    }
+    uint msb = 31 - __builtin_clz(us);
+    return 16 + (msb - 4) * 4 + ((us >> (msb - 2)) & 3);
+}
+
+uint32_t latency_histogram::bucket_low(uint index)
+{
+    if (index < 16)
+    {
+        return index;
+    }
+    uint msb = (index - 16) / 4 + 4;
+    return (4 + (index - 16) % 4) << (msb - 2);
+}
+
+
+static const char* stage_names[] = {"vsync->pixel", "capture", "convert", "encode", "transmit"};
+static_assert(sizeof(stage_names) / sizeof(stage_names[0]) == size_t(perf_stage::COUNT), "a name for every stage");
+
+#if OV7670_PERF
+
+static latency_histogram histograms[size_t(perf_stage::COUNT)];
+
+void perf_record(perf_stage stage, uint32_t us)
+{
+    histograms[size_t(stage)].add(us);
+}
+
+void perf_print()
+{
+    printf(">> stage           count      min      p50      p99      max (us)\n");
+    for (size_t i = 0; i < size_t(perf_stage::COUNT); i++)
+    {
+        const latency_histogram& h = histograms[i];
+        printf(">> %-12s %8d %8d %8d %8d %8d\n", stage_names[i], h.get_count(), h.get_min(),
+               h.percentile(500), h.percentile(990), h.get_max());
+    }
+}
+
+void perf_reset()
+{
+    for (auto& h : histograms)
+    {
+        h.reset();
+    }
+}
+
+#else
+
+void perf_print()
+{
+    printf(">> stage instrumentation is compiled out, build with OV7670_PERF=1\n");
+}
+
+#endif
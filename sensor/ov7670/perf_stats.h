@@ -0,0 +1,100 @@
+#ifndef PERF_STATS_H_
+#define PERF_STATS_H_
+
+#include <pico/stdlib.h>
+
+/*
+per stage latency instrumentation of the camera path
+every frame records its stage durations into a fixed size histogram per stage,
+buckets are logarithmic, 4 per power of two, so p50/p99 are within 12.5% and a histogram is 512 bytes.
+min and max are exact.
+
+each stage is recorded by one core only, VSYNC_TO_PIXEL and CAPTURE by core1, the others by core0.
+build with OV7670_PERF=0 and every record compiles to nothing
+*/
+
+#ifndef OV7670_PERF
+#define OV7670_PERF 1
+#endif
+
+enum class perf_stage : uint8_t
+{
+    VSYNC_TO_PIXEL,     // VSYNC falling edge -> first pixel of the frame
+    CAPTURE,            // VSYNC falling edge -> last byte in memory
+    CONVERT,            // pixel conversion and ascii rendering
+    ENCODE,             // delta encoding
+    TRANSMIT,           // frame header, crc and USB CDC write
+    COUNT
+};
+
+
+class latency_histogram
+{
+public:
+    static const uint BUCKETS = 128;
+
+    void add(uint32_t us);
+    void reset();
+    uint32_t percentile(uint32_t per_mille) const;      // bucket middle, exact min and max at the ends
+
+    uint32_t get_count() const { return count_; }
+    uint32_t get_min() const { return count_ ? min_ : 0; }
+    uint32_t get_max() const { return max_; }
+
+private:
+    static uint bucket_index(uint32_t us);
+    static uint32_t bucket_low(uint index);
+
+private:
+    uint32_t buckets_[BUCKETS] = {};
+    uint32_t count_ = 0;
+    uint32_t min_ = UINT32_MAX;
+    uint32_t max_ = 0;
+};
+
+
+#if OV7670_PERF
+
+void perf_record(perf_stage stage, uint32_t us);
+void perf_print();      // one line per stage: count, min, p50, p99, max
+void perf_reset();
+
+// measures from construction to stop() or the end of the scope, whichever comes first
+class perf_span
+{
+public:
+    explicit perf_span(perf_stage stage) : stage_(stage), start_(time_us_32()) {}
+    ~perf_span() { stop(); }
+
+    void stop()
+    {
+        if (!stopped_)
+        {
+            perf_record(stage_, time_us_32() - start_);
+            stopped_ = true;
+        }
+    }
+
+private:
+    perf_stage stage_;
+    uint32_t start_;
+    bool stopped_ = false;
+};
+
+#else
+
+inline void perf_record(perf_stage stage, uint32_t us) {}
+void perf_print();
+inline void perf_reset() {}
+
+class perf_span
+{
+public:
+    explicit perf_span(perf_stage stage) {}
+    void stop() {}
+};
+
+#endif
+
+
+#endif
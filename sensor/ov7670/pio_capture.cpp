@@ -0,0 +1,326 @@
+#include "pio_capture.h"
+#include <hardware/irq.h>
+#include "ov7670_capture.pio.h"
+#include "reg_config.h"
+#include "frame_format.h"
+
+static_assert(ov7670_capture_VSYNC_PIN == GPIO_VSYNC, "VSYNC pin in ov7670_capture.pio doesn't match wiring");
+static_assert(ov7670_capture_HREF_PIN == GPIO_HREF, "HREF pin in ov7670_capture.pio doesn't match wiring");
+static_assert(ov7670_capture_PCLK_PIN == GPIO_PCLK, "PCLK pin in ov7670_capture.pio doesn't match wiring");
+static_assert(ov7670_capture_luma_VSYNC_PIN == GPIO_VSYNC, "VSYNC pin in ov7670_capture.pio doesn't match wiring");
+static_assert(ov7670_capture_luma_HREF_PIN == GPIO_HREF, "HREF pin in ov7670_capture.pio doesn't match wiring");
+static_assert(ov7670_capture_luma_PCLK_PIN == GPIO_PCLK, "PCLK pin in ov7670_capture.pio doesn't match wiring");
+
+// the capture layout is chosen at build time, see frame_format.h
+static const pio_program_t& capture_program = OV7670_LUMA_ONLY ? ov7670_capture_luma_program : ov7670_capture_program;
+static void (*const capture_program_init)(PIO, uint, uint, uint) =
+    OV7670_LUMA_ONLY ? ov7670_capture_luma_program_init : ov7670_capture_program_init;
+
+pio_capture* pio_capture::instance_ = nullptr;
+
+pio_capture::pio_capture(PIO pio, uint data_base_pin)
+    : pio_(pio)
+    , data_base_pin_(data_base_pin)
+    , pio_irq_(pio == pio0 ? PIO0_IRQ_0 : PIO1_IRQ_0)
+{
+}
+
+pio_capture::~pio_capture()
+{
+    if (dma_chan_ < 0)
+    {
+        return;
+    }
+
+    abort_capture();
+    irq_remove_handler(DMA_IRQ_0, dma_irq_handler);
+    irq_remove_handler(pio_irq_, pio_irq_handler);
+    dma_channel_unclaim(dma_chan_);
+    dma_channel_unclaim(dma_chan2_);
+    pio_sm_unclaim(pio_, sm_);
+    pio_remove_program(pio_, &capture_program, offset_);
+    instance_ = nullptr;
+}
+
+void pio_capture::init_dev()
+{
+    instance_ = this;
+
+    // state machine
+    offset_ = pio_add_program(pio_, &capture_program);
+    sm_ = pio_claim_unused_sm(pio_, true);
+    capture_program_init(pio_, sm_, offset_, data_base_pin_);
+
+    // frame start and first pixel interrupts, raised by "irq nowait 0 rel" and "irq nowait 1 rel"
+    pio_set_irq0_source_enabled(pio_, (pio_interrupt_source)(pis_interrupt0 + sm_), true);
+    pio_set_irq0_source_enabled(pio_, (pio_interrupt_source)(pis_interrupt0 + (sm_ + 1) % 4), true);
+    irq_add_shared_handler(pio_irq_, pio_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(pio_irq_, true);
+
+    // dma, pio rx fifo -> frame buffer, one word per transfer
+    dma_chan_ = dma_claim_unused_channel(true);
+    dma_chan2_ = dma_claim_unused_channel(true);
+    dma_channel_set_irq0_enabled(dma_chan_, true);
+    dma_channel_set_irq0_enabled(dma_chan2_, true);
+    irq_add_shared_handler(DMA_IRQ_0, dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0, true);
+}
+
+bool pio_capture::start_capture(uint8_t* buf, size_t len)
+{
+    if (dma_chan_ < 0 || !buf || len == 0 || (len % 4) || (uintptr_t(buf) % 4))
+    {
+        return false;
+    }
+
+    abort_capture();
+    buf_ = buf;
+    len_ = len;
+    streaming_ = false;
+    frame_ready_ = false;
+    busy_ = true;
+
+    // restart from the first instruction with empty fifos and shift counters
+    pio_sm_clear_fifos(pio_, sm_);
+    pio_sm_restart(pio_, sm_);
+    pio_sm_exec(pio_, sm_, pio_encode_jmp(offset_));
+
+    dma_channel_config c = dma_channel_get_default_config(dma_chan_);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, pio_get_dreq(pio_, sm_, false));
+    dma_channel_configure(dma_chan_, &c, buf, &pio_->rxf[sm_], len / 4, true);
+
+    // byte counter for "jmp x--"
+    pio_sm_put(pio_, sm_, len - 1);
+    pio_sm_set_enabled(pio_, sm_, true);
+    return true;
+}
+
+bool pio_capture::start_stream(uint8_t* ring, size_t line_bytes, size_t ring_lines, size_t lines)
+{
+    if (dma_chan_ < 0 || !ring || line_bytes == 0 || (line_bytes % 4) || (uintptr_t(ring) % 4) || ring_lines < 3 || lines == 0)
+    {
+        return false;
+    }
+
+    abort_capture();
+    buf_ = ring;
+    len_ = line_bytes * lines;
+    line_bytes_ = line_bytes;
+    ring_lines_ = ring_lines;
+    lines_ = lines;
+    lines_done_ = 0;
+    lines_released_ = 0;
+    lines_taken_ = 0;
+    streaming_ = true;
+    frame_ready_ = false;
+    busy_ = true;
+
+    pio_sm_clear_fifos(pio_, sm_);
+    pio_sm_restart(pio_, sm_);
+    pio_sm_exec(pio_, sm_, pio_encode_jmp(offset_));
+
+    // even lines by the first channel, odd lines by the second one, each channel triggers the other when its line is done.
+    // transfer count is reloaded on every trigger, write address is moved forward in the interrupt
+    dma_channel_config c = dma_channel_get_default_config(dma_chan_);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, pio_get_dreq(pio_, sm_, false));
+
+    channel_config_set_chain_to(&c, dma_chan_);
+    dma_channel_configure(dma_chan2_, &c, ring + line_bytes, &pio_->rxf[sm_], line_bytes / 4, false);
+    channel_config_set_chain_to(&c, dma_chan2_);
+    dma_channel_configure(dma_chan_, &c, ring, &pio_->rxf[sm_], line_bytes / 4, true);
+
+    pio_sm_put(pio_, sm_, len_ - 1);
+    pio_sm_set_enabled(pio_, sm_, true);
+    return true;
+}
+
+const uint8_t* pio_capture::get_line(uint32_t timeout_us)
+{
+    if (!streaming_ || lines_taken_ >= lines_)
+    {
+        return nullptr;
+    }
+
+    absolute_time_t timeout = make_timeout_time_us(timeout_us);
+    while (lines_done_ <= lines_taken_)
+    {
+        if (time_reached(timeout))
+        {
+            abort_capture();
+            return nullptr;
+        }
+        __wfe();
+    }
+    return buf_ + (lines_taken_++ % ring_lines_) * line_bytes_;
+}
+
+void pio_capture::release_line()
+{
+    if (lines_released_ < lines_taken_)
+    {
+        ++lines_released_;
+    }
+}
+
+void pio_capture::abort_capture()
+{
+    if (dma_chan_ < 0)
+    {
+        return;
+    }
+
+    pio_sm_set_enabled(pio_, sm_, false);
+    if (busy_)
+    {
+        // abort may raise a completion interrupt, clear it before anyone sees it
+        int chans[2] = {dma_chan_, dma_chan2_};
+        for (int chan : chans)
+        {
+            dma_channel_set_irq0_enabled(chan, false);
+            dma_channel_abort(chan);
+            dma_channel_acknowledge_irq0(chan);
+            dma_channel_set_irq0_enabled(chan, true);
+        }
+        busy_ = false;
+    }
+}
+
+bool pio_capture::wait_for_frame(uint32_t timeout_us)
+{
+    absolute_time_t timeout = make_timeout_time_us(timeout_us);
+    while (busy_)
+    {
+        if (time_reached(timeout))
+        {
+            abort_capture();
+            return false;
+        }
+        // woken up by dma or pio interrupt
+        __wfe();
+    }
+    return frame_ready_;
+}
+
+size_t pio_capture::get_bytes_captured() const
+{
+    if (!busy_)
+    {
+        return frame_ready_ ? len_ : 0;
+    }
+    if (streaming_)
+    {
+        return lines_done_ * line_bytes_;
+    }
+    return dma_channel_hw_addr(dma_chan_)->write_addr - uintptr_t(buf_);
+}
+
+void pio_capture::set_frame_callback(frame_callback_t callback, void* user_data)
+{
+    callback_ = callback;
+    user_data_ = user_data;
+}
+
+float pio_capture::get_fps() const
+{
+    return frame_interval_us_ ? 1000000.0f / frame_interval_us_ : 0.0f;
+}
+
+void pio_capture::on_frame_complete()
+{
+    uint32_t now = time_us_32();
+    capture_time_us_ = now - frame_start_us_;
+    frame_interval_us_ = last_frame_end_us_ ? now - last_frame_end_us_ : 0;
+    last_frame_end_us_ = now;
+    ++frame_count_;
+
+    pio_sm_set_enabled(pio_, sm_, false);
+    if (streaming_)
+    {
+        // the last line has triggered the other channel, it is waiting for data which never comes
+        abort_capture();
+    }
+    busy_ = false;
+    frame_ready_ = true;
+
+    if (callback_)
+    {
+        callback_(buf_, len_, user_data_);
+    }
+}
+
+void pio_capture::on_line_complete(uint chan)
+{
+    // line n is done, the other channel is writing line n + 1, this channel takes line n + 2
+    uint32_t next = ++lines_done_ + 1;
+    if (lines_done_ >= lines_)
+    {
+        on_frame_complete();
+        return;
+    }
+
+    if (next < lines_)
+    {
+        if (next >= lines_released_ + ring_lines_)
+        {
+            ++overrun_lines_;   // consumer is too slow, the oldest unreleased line is overwritten
+        }
+        dma_channel_set_write_addr(chan, buf_ + (next % ring_lines_) * line_bytes_, false);
+    }
+}
+
+void pio_capture::dma_irq_handler()
+{
+    if (!instance_)
+    {
+        return;
+    }
+
+    if (!instance_->streaming_)
+    {
+        if (dma_channel_get_irq0_status(instance_->dma_chan_))
+        {
+            dma_channel_acknowledge_irq0(instance_->dma_chan_);
+            instance_->on_frame_complete();
+        }
+        return;
+    }
+
+    // lines complete in order, even lines on the first channel, odd lines on the second one
+    while (instance_->busy_)
+    {
+        uint chan = (instance_->lines_done_ % 2) ? instance_->dma_chan2_ : instance_->dma_chan_;
+        if (!dma_channel_get_irq0_status(chan))
+        {
+            break;
+        }
+        dma_channel_acknowledge_irq0(chan);
+        instance_->on_line_complete(chan);
+    }
+}
+
+void pio_capture::pio_irq_handler()
+{
+    if (!instance_)
+    {
+        return;
+    }
+
+    uint start_irq = instance_->sm_;
+    uint pixel_irq = (instance_->sm_ + 1) % 4;
+    if (pio_interrupt_get(instance_->pio_, start_irq))
+    {
+        pio_interrupt_clear(instance_->pio_, start_irq);
+        instance_->frame_start_us_ = time_us_32();
+    }
+    if (pio_interrupt_get(instance_->pio_, pixel_irq))
+    {
+        pio_interrupt_clear(instance_->pio_, pixel_irq);
+        instance_->first_pixel_us_ = time_us_32();
+    }
+}
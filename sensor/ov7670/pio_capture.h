@@ -0,0 +1,123 @@
+#ifndef PIO_CAPTURE_H_
+#define PIO_CAPTURE_H_
+
+#include <pico/stdlib.h>
+#include <hardware/pio.h>
+#include <hardware/dma.h>
+
+/*
+ov7670 capture engine, PIO + DMA
+the PIO state machine waits for VSYNC, samples D0-D7 on PCLK raising edge while HREF is high,
+DMA streams the bytes straight into the frame buffer, the CPU is free during the capture.
+a luma only build (frame_format.h) loads the variant which stores the Y bytes of YUV422 only.
+
+frame complete is reported by the DMA interrupt, through is_frame_ready() flag or the frame callback
+VSYNC, HREF and PCLK pins are fixed in ov7670_capture.pio
+
+line streaming mode: two chained DMA channels fill a small ring of line buffers,
+so a frame of any size is captured with constant memory, every line should be consumed before the ring wraps
+*/
+
+// called in interrupt context, keep it short
+typedef void (*frame_callback_t)(uint8_t* buf, size_t len, void* user_data);
+
+
+class pio_capture
+{
+public:
+    pio_capture(PIO pio, uint data_base_pin);
+    ~pio_capture();
+
+public:
+    void init_dev();        // load pio program, claim state machine and dma channel
+
+    /*
+    arm the capture of the next frame, return immediately
+    @param buf frame buffer, 4 bytes aligned
+    @param len bytes of one frame, multiple of 4
+    @return false if the engine is not initialized or the parameters are invalid
+    */
+    bool start_capture(uint8_t* buf, size_t len);
+    void abort_capture();
+
+    /*
+    sleep until current frame complete
+    @return false if timeout, the capture is aborted
+    */
+    bool wait_for_frame(uint32_t timeout_us);
+
+    /*
+    arm line streaming of the next frame
+    @param ring ring_lines * line_bytes buffer, 4 bytes aligned
+    @param line_bytes bytes of one line, multiple of 4
+    @param ring_lines lines in the ring, at least 3, two are in flight
+    @param lines lines of one frame
+    */
+    bool start_stream(uint8_t* ring, size_t line_bytes, size_t ring_lines, size_t lines);
+
+    /*
+    take the next complete line of the stream in order
+    @return nullptr if timeout or all lines of the frame are taken
+    */
+    const uint8_t* get_line(uint32_t timeout_us);
+    void release_line();    // the line taken by get_line() can be overwritten
+
+    bool is_frame_ready() const { return frame_ready_; }
+    size_t get_bytes_captured() const;      // bytes of the current frame already in memory, follows the DMA
+    bool is_busy() const { return busy_; }
+    void set_frame_callback(frame_callback_t callback, void* user_data);
+
+    // statistics
+    uint32_t get_frame_count() const { return frame_count_; }
+    uint32_t get_capture_time_us() const { return capture_time_us_; }   // VSYNC -> last byte of the last frame
+    uint32_t get_frame_start_us() const { return frame_start_us_; }     // VSYNC timestamp of the last frame
+    uint32_t get_first_pixel_us() const { return first_pixel_us_; }     // first HREF timestamp of the last frame
+    uint32_t get_frame_interval_us() const { return frame_interval_us_; }
+    float get_fps() const;                                               // measured from the interval of complete frames
+    uint32_t get_overrun_lines() const { return overrun_lines_; }        // stream lines overwritten before released
+
+private:
+    static void dma_irq_handler();
+    static void pio_irq_handler();
+    void on_frame_complete();
+    void on_line_complete(uint chan);
+
+private:
+    PIO pio_;
+    uint sm_ = 0;
+    uint offset_ = 0;
+    int dma_chan_ = -1;
+    int dma_chan2_ = -1;    // second channel of the line stream
+    uint data_base_pin_;
+    uint pio_irq_;
+
+    uint8_t* buf_ = nullptr;
+    size_t len_ = 0;
+
+    // line stream
+    bool streaming_ = false;
+    size_t line_bytes_ = 0;
+    size_t ring_lines_ = 0;
+    size_t lines_ = 0;
+    volatile uint32_t lines_done_ = 0;
+    volatile uint32_t lines_released_ = 0;
+    uint32_t lines_taken_ = 0;
+    volatile uint32_t overrun_lines_ = 0;
+
+    frame_callback_t callback_ = nullptr;
+    void* user_data_ = nullptr;
+
+    volatile bool frame_ready_ = false;
+    volatile bool busy_ = false;
+    volatile uint32_t frame_start_us_ = 0;
+    volatile uint32_t first_pixel_us_ = 0;
+    volatile uint32_t frame_count_ = 0;
+    volatile uint32_t capture_time_us_ = 0;
+    volatile uint32_t frame_interval_us_ = 0;
+    uint32_t last_frame_end_us_ = 0;
+
+    static pio_capture* instance_;      // irq handlers can not carry user data
+};
+
+
+#endif
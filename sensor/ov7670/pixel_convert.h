@@ -0,0 +1,213 @@
+#ifndef PIXEL_CONVERT_H_
+#define PIXEL_CONVERT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "frame_protocol.h"
+
+/*
+pixel format conversion kernels, shared by the firmware and the PC side tools (host/)
+the kernels work on 32-bit words, two 16-bit lanes per word (SWAR), so one multiply or one shift handles two pixels.
+pixel buffers must be 4 bytes aligned and pixel counts multiple of 4, every ov7670 line is.
+
+YUV422: Y,U,Y,V bytes, two pixels share U and V
+RGB565: big endian as the sensor sends it, RRRRRGGG GGGBBBBB
+*/
+
+// word access, the compiler emits one ldr/str, cortex-m0+ can not load unaligned words
+inline uint32_t load_word(const uint8_t* p)
+{
+    uint32_t w;
+    memcpy(&w, __builtin_assume_aligned(p, 4), 4);
+    return w;
+}
+
+inline void store_word(uint8_t* p, uint32_t w)
+{
+    memcpy(__builtin_assume_aligned(p, 4), &w, 4);
+}
+
+
+/*
+YUV422 -> luma, 4 pixels per iteration
+Y0 and Y1 are the bytes 0 and 2 of every word, mask them and fold the two lanes together
+*/
+inline void yuv422_to_luma(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i += 4)
+    {
+        uint32_t a = load_word(src + 2 * i) & 0x00ff00ff;       // Y1 . Y0
+        uint32_t b = load_word(src + 2 * i + 4) & 0x00ff00ff;   // Y3 . Y2
+        a = (a | (a >> 8)) & 0xffff;
+        b = (b | (b >> 8)) & 0xffff;
+        store_word(dst + i, a | (b << 16));
+    }
+}
+
+
+/*
+RGB565 -> luma, 4 pixels per iteration
+Y = 0.299 R + 0.587 G + 0.114 B with the weights scaled to the 5/6/5 bit channels and * 256,
+white sums to 65402, so R, G and B products of two pixels never leave their 16-bit lane
+*/
+const uint32_t RGB565_LUMA_R = 630;     // 0.299 * 255 / 31 * 256
+const uint32_t RGB565_LUMA_G = 608;     // 0.587 * 255 / 63 * 256
+const uint32_t RGB565_LUMA_B = 240;     // 0.114 * 255 / 31 * 256
+
+inline uint32_t rgb565_luma_pair(uint32_t w)
+{
+    // sensor byte order -> pixel 0 in the high lane, pixel 1 in the low lane
+    uint32_t p = __builtin_bswap32(w);
+    uint32_t r = (p >> 11) & 0x001f001f;
+    uint32_t g = (p >> 5) & 0x003f003f;
+    uint32_t b = p & 0x001f001f;
+    uint32_t y = (r * RGB565_LUMA_R + g * RGB565_LUMA_G + b * RGB565_LUMA_B + 0x00800080) >> 8;
+    // high lane is the first pixel
+    return ((y >> 16) & 0xff) | ((y & 0xff) << 8);
+}
+
+inline void rgb565_to_luma(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i += 4)
+    {
+        uint32_t a = rgb565_luma_pair(load_word(src + 2 * i));
+        uint32_t b = rgb565_luma_pair(load_word(src + 2 * i + 4));
+        store_word(dst + i, a | (b << 16));
+    }
+}
+
+
+/*
+YUV422 -> RGB565, 2 pixels per iteration
+BT.601 full range in 8.8 fixed point, the chroma terms are computed once per pair and added to both lanes.
+lanes carry Y + 256 so a negative result stays positive, saturation is done on both lanes at once:
+bit 9 set -> above 255, bits 8 and 9 clear -> below 0
+*/
+inline uint32_t swar_saturate_pair(uint32_t x)
+{
+    uint32_t over = ((x >> 9) & 0x00010001) * 0xff;
+    uint32_t under = ((((x >> 8) | (x >> 9)) & 0x00010001) ^ 0x00010001) * 0xff;
+    return ((x | over) & ~under) & 0x00ff00ff;
+}
+
+inline uint32_t yuv422_rgb565_pair(uint32_t w)
+{
+    int32_t u = int32_t((w >> 8) & 0xff) - 128;
+    int32_t v = int32_t(w >> 24) - 128;
+    int32_t dr = (359 * v) >> 8;            // 1.402
+    int32_t dg = (-88 * u - 183 * v) >> 8;  // 0.344, 0.714
+    int32_t db = (454 * u) >> 8;            // 1.772
+
+    // Y1 in the high lane, Y0 in the low lane, both + 256
+    uint32_t y = (w & 0x00ff00ff) + 0x01000100;
+    uint32_t r = swar_saturate_pair(y + uint32_t(dr * 0x10001));
+    uint32_t g = swar_saturate_pair(y + uint32_t(dg * 0x10001));
+    uint32_t b = swar_saturate_pair(y + uint32_t(db * 0x10001));
+
+    uint32_t p = ((r & 0x00f800f8) << 8) | ((g & 0x00fc00fc) << 3) | ((b >> 3) & 0x001f001f);
+    // sensor byte order, high byte first in each pixel
+    return ((p & 0x00ff00ff) << 8) | ((p >> 8) & 0x00ff00ff);
+}
+
+inline void yuv422_to_rgb565(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i += 2)
+    {
+        store_word(dst + 2 * i, yuv422_rgb565_pair(load_word(src + 2 * i)));
+    }
+}
+
+
+/*
+Y8 -> RGB565 grey, 2 pixels per iteration, r = g = b = y
+*/
+inline uint32_t y8_rgb565_pixel(uint32_t y)
+{
+    uint32_t p = ((y >> 3) << 11) | ((y >> 2) << 5) | (y >> 3);
+    // sensor byte order, high byte first
+    return (p >> 8) | ((p & 0xff) << 8);
+}
+
+inline void y8_to_rgb565(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i += 2)
+    {
+        store_word(dst + 2 * i, y8_rgb565_pixel(src[i]) | (y8_rgb565_pixel(src[i + 1]) << 16));
+    }
+}
+
+
+/*
+reference kernels, one pixel at a time, the SWAR kernels must give the same bytes
+*/
+inline void yuv422_to_luma_ref(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i++)
+    {
+        dst[i] = src[2 * i];
+    }
+}
+
+inline void rgb565_to_luma_ref(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i++)
+    {
+        uint32_t p = (src[2 * i] << 8) | src[2 * i + 1];
+        uint32_t y = (p >> 11) * RGB565_LUMA_R + ((p >> 5) & 0x3f) * RGB565_LUMA_G + (p & 0x1f) * RGB565_LUMA_B;
+        dst[i] = (y + 128) >> 8;
+    }
+}
+
+inline void yuv422_to_rgb565_ref(const uint8_t* src, uint8_t* dst, size_t pixels)
+{
+    auto clamp = [](int32_t x) { return x < 0 ? 0 : (x > 255 ? 255 : x); };
+    for (size_t i = 0; i < pixels; i++)
+    {
+        const uint8_t* pair = src + 4 * (i / 2);
+        int32_t y = src[2 * i];
+        int32_t u = pair[1] - 128;
+        int32_t v = pair[3] - 128;
+        int32_t r = clamp(y + ((359 * v) >> 8));
+        int32_t g = clamp(y + ((-88 * u - 183 * v) >> 8));
+        int32_t b = clamp(y + ((454 * u) >> 8));
+        uint32_t p = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+        dst[2 * i] = p >> 8;
+        dst[2 * i + 1] = p & 0xff;
+    }
+}
+
+
+/*
+compile time specialization per capture format, the per pixel code has no format switch
+    pixel_kernels<pixel_format::YUV422>::to_luma(line, luma, width);
+*/
+template <pixel_format F>
+struct pixel_kernels;
+
+template <>
+struct pixel_kernels<pixel_format::YUV422>
+{
+    static constexpr size_t BYTES_PER_PIXEL = 2;
+    static void to_luma(const uint8_t* src, uint8_t* dst, size_t pixels) { yuv422_to_luma(src, dst, pixels); }
+    static void to_rgb565(const uint8_t* src, uint8_t* dst, size_t pixels) { yuv422_to_rgb565(src, dst, pixels); }
+};
+
+template <>
+struct pixel_kernels<pixel_format::RGB565>
+{
+    static constexpr size_t BYTES_PER_PIXEL = 2;
+    static void to_luma(const uint8_t* src, uint8_t* dst, size_t pixels) { rgb565_to_luma(src, dst, pixels); }
+    static void to_rgb565(const uint8_t* src, uint8_t* dst, size_t pixels) { memcpy(dst, src, pixels * 2); }
+};
+
+template <>
+struct pixel_kernels<pixel_format::Y8>
+{
+    static constexpr size_t BYTES_PER_PIXEL = 1;
+    static void to_luma(const uint8_t* src, uint8_t* dst, size_t pixels) { memcpy(dst, src, pixels); }
+    static void to_rgb565(const uint8_t* src, uint8_t* dst, size_t pixels) { y8_to_rgb565(src, dst, pixels); }
+};
+
+
+#endif
@@ -0,0 +1,192 @@
+#include "qoi_codec.h"
+#include <string.h>
+#include "pixel_convert.h"
+
+static const uint32_t QOI_START = 0x80008000;  // Y0 = 0, U = 128, Y1 = 0, V = 128
+
+static inline uint32_t qoi_hash(uint32_t unit)
+{
+    return (unit * 0x9e3779b1u) >> 26;
+}
+
+void qoi_encoder::begin_frame()
+{
+    prev_ = QOI_START;
+    memset(cache_, 0, sizeof(cache_));
+}
+
+size_t qoi_encoder::encode_line(const uint8_t* line, size_t line_bytes, uint8_t* out)
+{
+    uint8_t* p = out;
+    uint32_t prev = prev_;
+    uint32_t run = 0;
+
+    for (size_t i = 0; i < line_bytes; i += 4)
+    {
+        uint32_t unit = load_word(line + i);
+        if (unit == prev)
+        {
+            if (++run == QOI_MAX_RUN)
+            {
+                *p++ = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+            continue;
+        }
+        if (run)
+        {
+            *p++ = QOI_OP_RUN | (run - 1);
+            run = 0;
+        }
+
+        uint32_t h = qoi_hash(unit);
+        if (cache_[h] == unit)
+        {
+            *p++ = QOI_OP_INDEX | h;
+            prev = unit;
+            continue;
+        }
+        cache_[h] = unit;
+
+        // little endian word, Y0 in the lowest byte
+        int dy0 = int8_t(unit - prev);
+        int dy1 = int8_t(int8_t((unit >> 16) - (prev >> 16)) - dy0);
+        int du = int8_t((unit >> 8) - (prev >> 8));
+        int dv = int8_t((unit >> 24) - (prev >> 24));
+
+        if (du == 0 && dv == 0 && dy0 >= -4 && dy0 < 4 && dy1 >= -4 && dy1 < 4)
+        {
+            *p++ = QOI_OP_DIFF | ((dy0 + 4) << 3) | (dy1 + 4);
+        }
+        else if (dy0 >= -32 && dy0 < 32 && dy1 >= -8 && dy1 < 8 && du >= -2 && du < 2 && dv >= -2 && dv < 2)
+        {
+            *p++ = QOI_OP_LUMA | (dy0 + 32);
+            *p++ = ((dy1 + 8) << 4) | ((du + 2) << 2) | (dv + 2);
+        }
+        else
+        {
+            *p++ = QOI_OP_FULL;
+            memcpy(p, line + i, 4);
+            p += 4;
+        }
+        prev = unit;
+    }
+
+    if (run)
+    {
+        *p++ = QOI_OP_RUN | (run - 1);
+    }
+    prev_ = prev;
+    return p - out;
+}
+
+
+void qoi_decoder::begin_frame()
+{
+    prev_ = QOI_START;
+    memset(cache_, 0, sizeof(cache_));
+}
+
+const uint8_t* qoi_decoder::decode_line(const uint8_t* src, const uint8_t* end, uint8_t* line, size_t line_bytes)
+{
+    uint32_t prev = prev_;
+    size_t i = 0;
+    while (i < line_bytes)
+    {
+        if (src >= end)
+        {
+            return nullptr;
+        }
+
+        uint8_t op = *src++;
+        uint32_t unit;
+        if (op == QOI_OP_FULL)
+        {
+            if (end - src < 4)
+            {
+                return nullptr;
+            }
+            memcpy(&unit, src, 4);
+            src += 4;
+            cache_[qoi_hash(unit)] = unit;
+        }
+        else if ((op & 0xc0) == QOI_OP_RUN)
+        {
+            size_t run = (op & 0x3f) + 1;
+            if (op == 0xff || i + run * 4 > line_bytes)
+            {
+                return nullptr;
+            }
+            for (; run; run--, i += 4)
+            {
+                memcpy(line + i, &prev, 4);
+            }
+            continue;
+        }
+        else if ((op & 0xc0) == QOI_OP_INDEX)
+        {
+            unit = cache_[op & 0x3f];
+        }
+        else
+        {
+            int dy0, dy1, du = 0, dv = 0;
+            if ((op & 0xc0) == QOI_OP_DIFF)
+            {
+                dy0 = ((op >> 3) & 0x07) - 4;
+                dy1 = (op & 0x07) - 4;
+            }
+            else
+            {
+                if (src >= end)
+                {
+                    return nullptr;
+                }
+                uint8_t b = *src++;
+                dy0 = (op & 0x3f) - 32;
+                dy1 = (b >> 4) - 8;
+                du = ((b >> 2) & 0x03) - 2;
+                dv = (b & 0x03) - 2;
+            }
+            dy1 += dy0;
+            unit = uint32_t(uint8_t(prev + dy0)) | (uint32_t(uint8_t((prev >> 8) + du)) << 8) |
+                   (uint32_t(uint8_t((prev >> 16) + dy1)) << 16) | (uint32_t(uint8_t((prev >> 24) + dv)) << 24);
+            cache_[qoi_hash(unit)] = unit;
+        }
+
+        memcpy(line + i, &unit, 4);
+        i += 4;
+        prev = unit;
+    }
+    prev_ = prev;
+    return src;
+}
+
+
+size_t qoi_encode(const uint8_t* src, size_t line_bytes, size_t lines, uint8_t* out)
+{
+    qoi_encoder encoder;
+    encoder.begin_frame();
+    uint8_t* p = out;
+    for (size_t y = 0; y < lines; y++)
+    {
+        p += encoder.encode_line(src + y * line_bytes, line_bytes, p);
+    }
+    return p - out;
+}
+
+bool qoi_decode(const uint8_t* payload, size_t len, uint8_t* dst, size_t line_bytes, size_t lines)
+{
+    qoi_decoder decoder;
+    decoder.begin_frame();
+    const uint8_t* p = payload;
+    const uint8_t* end = payload + len;
+    for (size_t y = 0; y < lines; y++)
+    {
+        p = decoder.decode_line(p, end, dst + y * line_bytes, line_bytes);
+        if (!p)
+        {
+            return false;
+        }
+    }
+    return p == end;
+}
@@ -0,0 +1,82 @@
+#ifndef QOI_CODEC_H_
+#define QOI_CODEC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+lossless QOI style image codec, shared by the firmware and the PC side tools (host/)
+works on 4 byte units, one YUV422 pair Y0,U,Y1,V (or two RGB565 pixels), line by line with constant memory:
+the state is the previous unit, a 64 entry cache of seen units and a run counter, 264 bytes.
+runs are flushed at the end of every line, a line decodes on its own once the state is known.
+
+opcodes, first byte:
+00iiiiii            INDEX   unit is cache[i]
+01aaabbb            DIFF    U, V unchanged, dY0 = a - 4, dY1 = dY0 + b - 4
+10aaaaaa bbbbccdd   LUMA    dY0 = a - 32, dY1 = dY0 + b - 8, dU = c - 2, dV = d - 2
+11rrrrrr            RUN     previous unit r + 1 times, r < 62
+11111110 y0 u y1 v  FULL    unit as it is
+differences are modulo 256, against the previous unit, the cache slot is a multiplicative hash of the unit
+
+payload of a frame is the lines one after the other, the first previous unit is Y=0, U=V=128
+*/
+
+const uint8_t QOI_OP_INDEX = 0x00;
+const uint8_t QOI_OP_DIFF = 0x40;
+const uint8_t QOI_OP_LUMA = 0x80;
+const uint8_t QOI_OP_RUN = 0xc0;
+const uint8_t QOI_OP_FULL = 0xfe;
+const uint8_t QOI_MAX_RUN = 62;
+
+// worst case, every unit as FULL
+constexpr size_t qoi_max_encoded_size(size_t bytes)
+{
+    return bytes / 4 * 5;
+}
+
+
+class qoi_encoder
+{
+public:
+    void begin_frame();
+
+    /*
+    encode one line
+    @param line 4 bytes aligned, line_bytes multiple of 4
+    @param out at least qoi_max_encoded_size(line_bytes) bytes
+    @return encoded bytes
+    */
+    size_t encode_line(const uint8_t* line, size_t line_bytes, uint8_t* out);
+
+private:
+    uint32_t prev_;
+    uint32_t cache_[64];
+};
+
+
+class qoi_decoder
+{
+public:
+    void begin_frame();
+
+    /*
+    decode one line
+    @return the byte after the line in src, nullptr if the payload is broken
+    */
+    const uint8_t* decode_line(const uint8_t* src, const uint8_t* end, uint8_t* line, size_t line_bytes);
+
+private:
+    uint32_t prev_;
+    uint32_t cache_[64];
+};
+
+
+/*
+whole frames
+@return encoded bytes
+*/
+size_t qoi_encode(const uint8_t* src, size_t line_bytes, size_t lines, uint8_t* out);
+bool qoi_decode(const uint8_t* payload, size_t len, uint8_t* dst, size_t line_bytes, size_t lines);
+
+
+#endif
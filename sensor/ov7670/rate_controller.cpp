@@ -0,0 +1,99 @@
+#include "rate_controller.h"
+#include <stdio.h>
+#include <hardware/clocks.h>
+
+static const uint8_t pll_factor[] = {1, 4, 6, 8};
+
+rate_controller::rate_controller(sccb_shadow& sccb, uint xclk_pin)
+    : sccb_(sccb)
+    , xclk_pin_(xclk_pin)
+{
+}
+
+rate_controller::~rate_controller() {}
+
+void rate_controller::apply(uint point)
+{
+    if (point >= RATE_POINT_COUNT)
+    {
+        return;
+    }
+
+    const rate_point& p = rate_points[point];
+    clock_gpio_init(xclk_pin_, CLOCKS_CLK_GPOUT0_CTRL_AUXSRC_VALUE_CLK_SYS, p.xclk_div);
+    sccb_.write(OV7670_REG_DBLV, p.pll << 6);
+    sccb_.write(OV7670_REG_CLKRC, p.clkrc);
+    point_ = point;
+    settling_ = true;
+    clean_windows_ = 0;
+}
+
+bool rate_controller::update(uint32_t frames, uint32_t capture_errors, uint32_t lost)
+{
+    uint32_t now = time_us_32();
+    if (now - window_start_us_ < RATE_WINDOW_US)
+    {
+        return false;
+    }
+
+    uint32_t window_frames = frames - last_frames_;
+    uint32_t window_errors = capture_errors - last_errors_;
+    uint32_t window_lost = lost - last_lost_;
+    last_frames_ = frames;
+    last_errors_ = capture_errors;
+    last_lost_ = lost;
+    window_start_us_ = now;
+
+    for (auto& h : hold_)
+    {
+        if (h)
+            --h;
+    }
+
+    if (settling_)
+    {
+        settling_ = false;
+        return false;
+    }
+
+    // the engine lost bytes, or the consumer missed more than a quarter of the frames
+    if (window_errors || window_lost * 4 > window_frames)
+    {
+        uint32_t& backoff = backoff_[point_];
+        backoff = backoff ? (backoff * 2 > RATE_MAX_BACKOFF ? RATE_MAX_BACKOFF : backoff * 2) : 1;
+        hold_[point_] = backoff;
+        if (point_ + 1 < RATE_POINT_COUNT)
+        {
+            apply(point_ + 1);
+            return true;
+        }
+        return false;
+    }
+
+    // clean, probe the next faster point once its backoff is over
+    if (++clean_windows_ >= RATE_CLEAN_WINDOWS && point_ > 0 && !hold_[point_ - 1])
+    {
+        apply(point_ - 1);
+        return true;
+    }
+    return false;
+}
+
+uint32_t rate_controller::get_xclk_hz() const
+{
+    return clock_get_hz(clk_sys) / rate_points[point_].xclk_div;
+}
+
+uint32_t rate_controller::get_internal_clock_hz() const
+{
+    const rate_point& p = rate_points[point_];
+    return uint32_t(uint64_t(get_xclk_hz()) * pll_factor[p.pll] / (2 * (p.clkrc + 1)));
+}
+
+void rate_controller::print() const
+{
+    const rate_point& p = rate_points[point_];
+    printf(">> rate point %d/%d: xclk %d kHz (div %d), pll x%d, clkrc %d, internal clock %d kHz\n",
+           point_, RATE_POINT_COUNT - 1, get_xclk_hz() / 1000, p.xclk_div, pll_factor[p.pll], p.clkrc,
+           get_internal_clock_hz() / 1000);
+}
@@ -0,0 +1,87 @@
+#ifndef RATE_CONTROLLER_H_
+#define RATE_CONTROLLER_H_
+
+#include <pico/stdlib.h>
+#include "sccb_shadow.h"
+
+/*
+adaptive frame rate controller
+the sensor clock is set by the XCLK divider of the pico, the PLL (DBLV) and the prescaler (CLKRC),
+internal clock = XCLK * PLL / (2 * (CLKRC + 1)), PCLK and the frame rate follow it.
+
+operating points go from the fastest to the slowest. once per window the controller looks at
+capture errors (frames not complete in time, the engine can not follow PCLK) and backpressure
+(complete frames the consumer never read in full, overwritten in the frame store or with overrun stream lines):
+    errors or backpressure -> one point slower, the failed point is not probed again for a while
+    clean for RATE_CLEAN_WINDOWS windows -> probe one point faster
+the backoff of a point doubles each time it fails, so the controller settles on the fastest clean point
+*/
+
+struct rate_point
+{
+    uint8_t xclk_div;   // clk_sys / xclk_div
+    uint8_t pll;        // DBLV[7:6], 0 bypass, 1 x4, 2 x6, 3 x8
+    uint8_t clkrc;      // prescaler, internal clock / (clkrc + 1)
+};
+
+static const rate_point rate_points[] =
+{
+    {8, 1, 1},
+    {10, 1, 1},         // power on default of this project
+    {10, 1, 2},
+    {10, 1, 3},
+    {10, 1, 5},
+    {10, 1, 7},
+    {10, 1, 11},
+};
+
+const uint RATE_POINT_COUNT = sizeof(rate_points) / sizeof(rate_points[0]);
+const uint RATE_DEFAULT_POINT = 1;
+const uint32_t RATE_WINDOW_US = 1000000;
+const uint32_t RATE_CLEAN_WINDOWS = 3;
+const uint32_t RATE_MAX_BACKOFF = 64;           // windows
+
+
+class rate_controller
+{
+public:
+    rate_controller(sccb_shadow& sccb, uint xclk_pin);
+    ~rate_controller();
+
+public:
+    void apply(uint point);     // program XCLK, DBLV and CLKRC, only changed registers are written
+
+    /*
+    feed the totals of the capture, call as often as wanted, decides once per window
+    @param frames captured frames
+    @param capture_errors frames aborted by the engine
+    @param lost captured frames the consumer never got in full, part of frames, counted in frames not lines:
+                the frame store counts overwritten frames, the line stream the frames with overrun lines
+    @return true if the operating point changed, frames in flight were taken at the old clock
+    */
+    bool update(uint32_t frames, uint32_t capture_errors, uint32_t lost);
+
+    uint get_point() const { return point_; }
+    uint32_t get_xclk_hz() const;
+    uint32_t get_internal_clock_hz() const;
+    void print() const;
+
+private:
+    sccb_shadow& sccb_;
+    uint xclk_pin_;
+    uint point_ = RATE_DEFAULT_POINT;
+
+    // window
+    uint32_t window_start_us_ = 0;
+    uint32_t last_frames_ = 0;
+    uint32_t last_errors_ = 0;
+    uint32_t last_lost_ = 0;
+    bool settling_ = true;          // the first window after a change is not judged
+
+    uint32_t clean_windows_ = 0;
+    uint32_t backoff_[RATE_POINT_COUNT] = {};   // windows to wait before probing the point
+    uint32_t hold_[RATE_POINT_COUNT] = {};      // windows left
+};
+
+
+#endif
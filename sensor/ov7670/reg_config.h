@@ -206,6 +206,11 @@ enum class OV7670_SIZE
 };
 
 
+// output resolution of each size
+inline constexpr uint ov7670_width(OV7670_SIZE size) { return 640 >> static_cast<uint>(size); }
+inline constexpr uint ov7670_height(OV7670_SIZE size) { return 480 >> static_cast<uint>(size); }
+
+
 enum class OV7670_COLOR
 {
   OV7670_COLOR_RGB = 0,  ///< RGB565 
@@ -221,29 +226,131 @@ struct i2c_command
 };
 
 
+/*
+register table sized by its initialiser, made by make_reg_sequence({...}) in a constexpr context,
+an address above OV7670_REG_LAST stops the compilation (there is no end marker, the size is known)
+
+merge_reg_sequences<a, b, ...>() makes one table of several, every register once,
+at its last position with its last value, no register is written twice.
+the last position keeps the order of the final writes: COM8 turning AGC/AEC on stays after the GAIN it starts from
+*/
+template <size_t N>
+struct reg_sequence
+{
+    i2c_command cmds[N];
+
+    constexpr size_t size() const { return N; }
+    constexpr const i2c_command& operator[](size_t i) const { return cmds[i]; }
+};
+
+// not constexpr, calling it at compile time is the error
+void ov7670_register_address_above_reg_last();
+
+template <size_t N>
+constexpr reg_sequence<N> make_reg_sequence(const i2c_command (&cmds)[N])
+{
+    reg_sequence<N> seq{};
+    for (size_t i = 0; i < N; i++)
+    {
+        if (cmds[i].addr > OV7670_REG_LAST)
+        {
+            ov7670_register_address_above_reg_last();
+        }
+        seq.cmds[i] = cmds[i];
+    }
+    return seq;
+}
+
+// registers of the tables, each counted once
+template <size_t... N>
+constexpr size_t reg_unique_count(const reg_sequence<N>&... seqs)
+{
+    bool seen[256] = {};
+    size_t count = 0;
+    auto add = [&](const auto& seq)
+    {
+        for (size_t i = 0; i < seq.size(); i++)
+        {
+            count += !seen[seq[i].addr];
+            seen[seq[i].addr] = true;
+        }
+    };
+    (add(seqs), ...);
+    return count;
+}
+
+template <const auto&... seqs>
+constexpr auto merge_reg_sequences()
+{
+    reg_sequence<reg_unique_count(seqs...)> merged{};
+    size_t last[256] = {};          // index + 1 of the last write over all the tables
+    size_t index = 0;
+    auto find_last = [&](const auto& seq)
+    {
+        for (size_t i = 0; i < seq.size(); i++)
+        {
+            last[seq[i].addr] = ++index;
+        }
+    };
+    (find_last(seqs), ...);
+
+    size_t count = 0;
+    index = 0;
+    auto add = [&](const auto& seq)
+    {
+        for (size_t i = 0; i < seq.size(); i++)
+        {
+            if (last[seq[i].addr] == ++index)
+            {
+                merged.cmds[count++] = seq[i];
+            }
+        }
+    };
+    (add(seqs), ...);
+    return merged;
+}
+
+// index of the register in the table, size() if the table does not write it
+template <size_t N>
+constexpr size_t reg_position(const reg_sequence<N>& seq, uint8_t addr)
+{
+    size_t i = 0;
+    while (i < N && seq[i].addr != addr)
+    {
+        i++;
+    }
+    return i;
+}
+
+// true if the table does not write first or writes it before second
+template <size_t N>
+constexpr bool reg_written_before(const reg_sequence<N>& seq, uint8_t first, uint8_t second)
+{
+    return reg_position(seq, first) == N || reg_position(seq, first) < reg_position(seq, second);
+}
+
+
 // colorspace setting
-static const i2c_command ov7670_rgb[4] = 
+static constexpr auto ov7670_rgb = make_reg_sequence(
 {
     // Manual output format, RGB, use RGB565 and full 0-255 output range
     {OV7670_REG_COM7, OV7670_COM7_RGB},
     {OV7670_REG_RGB444, 0},
     {OV7670_REG_COM15, OV7670_COM15_RGB565 | OV7670_COM15_R00FF},
-    // {0xFF, 0xFF}
-};
+});
 
 
-static const i2c_command ov7670_yuv[4] = 
+static constexpr auto ov7670_yuv = make_reg_sequence(
 {
     // Manual output format, YUV, use full output range
     {OV7670_REG_COM7, OV7670_COM7_YUV},
     {OV7670_REG_COM15, 0x00}
     // {OV7670_REG_COM15, OV7670_COM15_R00FF},
-    // {0xFF, 0xFF}
-};
+});
 
 
 // all register should be initialized
-static const i2c_command ov7670_init_cmd[] = 
+static constexpr auto ov7670_init_cmd = make_reg_sequence(
     {
         {OV7670_REG_TSLB, OV7670_TSLB_YLAST},    // No auto window
         //{OV7670_REG_COM10, OV7670_COM10_VS_NEG}, // -VSYNC (req by SAMD PCC)
@@ -349,15 +456,55 @@ static const i2c_command ov7670_init_cmd[] =
         {OV7670_REG_BRIGHT, 0x00},
         {OV7670_REG_CONTRAS, 0x40},
         {OV7670_REG_CONTRAS_CENTER, 0x80}, // 0x40?
-        {OV7670_REG_LAST + 1, 0x00}      // End-of-data marker
-    };
+    });
 
 
 // size register
 // reference: OV7670 Implementation Guide (V1.0)
-static const i2c_command ov7670_div8[] = 
+// DIVn, k = log2(n): COM14 = 0x18 + k, SCALING_DCWCTR = 0x11 * k, SCALING_PCLK_DIV = 0xf0 + k, DIV1 bypass the scaler
+// DCW down samples by 8 at most, DIV16 is DCW /8 plus a 0.5 zoom of the scaler (COM3 SCALEEN, XSC/YSC scale field 0x40)
+// CLKRC is left to the rate controller, a size switch keeps the sensor clock
+static constexpr auto ov7670_div1 = make_reg_sequence(
+{
+    {OV7670_REG_COM7, 0x00},
+    {OV7670_REG_COM3, 0x00},
+    {OV7670_REG_COM14, 0x00},
+    {OV7670_REG_SCALING_XSC, 0x3a},
+    {OV7670_REG_SCALING_YSC, 0x35},
+    {OV7670_REG_SCALING_DCWCTR, 0x00},
+    {OV7670_REG_SCALING_PCLK_DIV, 0x08},
+    {OV7670_REG_SCALING_PCLK_DELAY, 0x02}
+});
+
+
+static constexpr auto ov7670_div2 = make_reg_sequence(
+{
+    {OV7670_REG_COM7, 0x00},
+    {OV7670_REG_COM3, OV7670_COM3_DCWEN},
+    {OV7670_REG_COM14, 0x19},
+    {OV7670_REG_SCALING_XSC, 0x3a},
+    {OV7670_REG_SCALING_YSC, 0x35},
+    {OV7670_REG_SCALING_DCWCTR, 0x11},
+    {OV7670_REG_SCALING_PCLK_DIV, 0xf1},
+    {OV7670_REG_SCALING_PCLK_DELAY, 0x02}
+});
+
+
+static constexpr auto ov7670_div4 = make_reg_sequence(
+{
+    {OV7670_REG_COM7, 0x00},
+    {OV7670_REG_COM3, OV7670_COM3_DCWEN},
+    {OV7670_REG_COM14, 0x1a},
+    {OV7670_REG_SCALING_XSC, 0x3a},
+    {OV7670_REG_SCALING_YSC, 0x35},
+    {OV7670_REG_SCALING_DCWCTR, 0x22},
+    {OV7670_REG_SCALING_PCLK_DIV, 0xf2},
+    {OV7670_REG_SCALING_PCLK_DELAY, 0x02}
+});
+
+
+static constexpr auto ov7670_div8 = make_reg_sequence(
 {
-    {OV7670_REG_CLKRC, 0x01},
     {OV7670_REG_COM7, 0x00},
     {OV7670_REG_COM3, OV7670_COM3_DCWEN},
     {OV7670_REG_COM14, 0x1b},
@@ -366,7 +513,26 @@ static const i2c_command ov7670_div8[] =
     {OV7670_REG_SCALING_DCWCTR, 0x33},
     {OV7670_REG_SCALING_PCLK_DIV, 0xf3},
     {OV7670_REG_SCALING_PCLK_DELAY, 0x02}
-};
+});
+
+
+static constexpr auto ov7670_div16 = make_reg_sequence(
+{
+    {OV7670_REG_COM7, 0x00},
+    {OV7670_REG_COM3, OV7670_COM3_DCWEN | OV7670_COM3_SCALEEN},
+    {OV7670_REG_COM14, 0x1c},
+    {OV7670_REG_SCALING_XSC, 0x40},    // bit 7 test pattern off as in the other sizes, 0.5 zoom
+    {OV7670_REG_SCALING_YSC, 0x40},
+    {OV7670_REG_SCALING_DCWCTR, 0x33},
+    {OV7670_REG_SCALING_PCLK_DIV, 0xf4},
+    {OV7670_REG_SCALING_PCLK_DELAY, 0x02}
+});
+
+
+// power on registers, common setup, 80x60 and YUV merged, COM7 and COM8 are written once
+static constexpr auto ov7670_boot = merge_reg_sequences<ov7670_init_cmd, ov7670_div8, ov7670_yuv>();
+static_assert(reg_written_before(ov7670_boot, OV7670_REG_GAIN, OV7670_REG_COM8),
+              "COM8 enables AGC/AEC, it must come after the GAIN start value");
 
 const uint OV_SDA = 4;      // ov7670 SCCB data (Compatible with I2C protocol)
 const uint OV_SCL = 5;      // ov7670 SCCB clock (Compatible with I2C protocol)
@@ -388,9 +554,9 @@ const uint GPIO_D7 = 16;
 const uint32_t GPIO_DATA_MASK = (1UL << GPIO_D0) + (1UL << GPIO_D1) + (1UL << GPIO_D2) + (1UL << GPIO_D3) + 
                                 (1UL << GPIO_D4) + (1UL << GPIO_D5) + (1UL << GPIO_D6) + (1UL << GPIO_D7);
 
-auto i2c_instance = i2c_default;
+inline auto i2c_instance = i2c_default;   // inline, reg_config.h is shared by several source files
 
 // char map was used to convert greyscale image to ascii image
 // From http://www.paulbourke.net/dataformats/asciiart/
-const char charmap[71] = "$@B%8&WM#*oahkbdpqwmZO0QLCJUYXzcvunxrjft/\\|()1{}[]?-_+~<>i!lI;:,\"^`'. ";
+constexpr char charmap[71] = "$@B%8&WM#*oahkbdpqwmZO0QLCJUYXzcvunxrjft/\\|()1{}[]?-_+~<>i!lI;:,\"^`'. ";
 #endif
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include "sccb_shadow.h"
+#include <string.h>
+
+bool i2c_write_register(i2c_inst_t* i2c, uint8_t addr, uint8_t reg, uint8_t val)
+{
+    uint8_t data[2] = {reg, val}; 
+    return i2c_write_blocking(i2c, addr, data, 2, false) == 2;
+}
+
+
+uint8_t i2c_read_register(i2c_inst_t* i2c, uint8_t addr, uint8_t reg)
+{
+    uint8_t value;
+    i2c_write_blocking(i2c, addr, &reg, 1, false);
+    i2c_read_blocking(i2c, addr, &value, 1, false);
+    return value;
+}
+
+
+sccb_shadow::sccb_shadow(i2c_inst_t* i2c, uint8_t addr)
+    : i2c_(i2c)
+    , addr_(addr)
+{
+    invalidate();
+    memset(staged_, 0, sizeof(staged_));
+}
+
+sccb_shadow::~sccb_shadow() {}
+
+bool sccb_shadow::write(uint8_t reg, uint8_t value)
+{
+    if (is_known(reg) && value_[reg] == value && !is_volatile(reg))
+    {
+        ++stats_.skipped;
+        return true;
+    }
+
+    ++stats_.writes;
+    if (!i2c_write_register(i2c_, addr_, reg, value))
+    {
+        ++stats_.errors;
+        set_known(reg, false);
+        return false;
+    }
+
+    if (reg == OV7670_REG_COM7 && (value & OV7670_COM7_RESET))
+    {
+        // every register is back to its default value
+        invalidate();
+        return true;
+    }
+
+    value_[reg] = value;
+    set_known(reg, true);
+
+    if (verify_ && !is_volatile(reg) && read(reg) != value)
+    {
+        ++stats_.errors;
+        return false;
+    }
+    return true;
+}
+
+uint8_t sccb_shadow::read(uint8_t reg)
+{
+    ++stats_.reads;
+    uint8_t value = i2c_read_register(i2c_, addr_, reg);
+    value_[reg] = value;
+    set_known(reg, true);
+    return value;
+}
+
+void sccb_shadow::apply(const i2c_command* cmds, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        write(cmds[i].addr, cmds[i].value);
+    }
+}
+
+void sccb_shadow::stage(const i2c_command* cmds, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        uint8_t reg = cmds[i].addr;
+        if (staged_[reg / 32] & (1u << (reg % 32)))
+        {
+            // queued again, the register moves to the end like in merge_reg_sequences()
+            size_t pos = 0;
+            while (staged_order_[pos] != reg)
+            {
+                pos++;
+            }
+            memmove(&staged_order_[pos], &staged_order_[pos + 1], staged_count_ - pos - 1);
+            staged_order_[staged_count_ - 1] = reg;
+        }
+        else
+        {
+            staged_[reg / 32] |= 1u << (reg % 32);
+            staged_order_[staged_count_++] = reg;
+        }
+        staged_value_[reg] = cmds[i].value;
+    }
+}
+
+uint32_t sccb_shadow::commit()
+{
+    uint32_t writes = stats_.writes;
+    for (size_t i = 0; i < staged_count_; i++)
+    {
+        uint8_t reg = staged_order_[i];
+        write(reg, staged_value_[reg]);
+    }
+    staged_count_ = 0;
+    memset(staged_, 0, sizeof(staged_));
+    return stats_.writes - writes;
+}
+
+uint32_t sccb_shadow::verify_all()
+{
+    uint32_t mismatches = 0;
+    for (uint32_t reg = 0; reg <= OV7670_REG_LAST; reg++)
+    {
+        if (!is_known(reg) || is_volatile(reg))
+        {
+            continue;
+        }
+
+        uint8_t expected = value_[reg];
+        if (read(reg) != expected)
+        {
+            ++mismatches;
+            ++stats_.errors;
+        }
+    }
+    return mismatches;
+}
+
+void sccb_shadow::invalidate()
+{
+    memset(value_, 0, sizeof(value_));
+    memset(known_, 0, sizeof(known_));
+}
+
+bool sccb_shadow::is_volatile(uint8_t reg)
+{
+    // written back by AGC/AEC/AWB, or self clearing
+    switch (reg)
+    {
+    case OV7670_REG_GAIN:
+    case OV7670_REG_BLUE:
+    case OV7670_REG_RED:
+    case OV7670_REG_VREF:   // AGC[9:8]
+    case OV7670_REG_COM1:   // AEC[1:0]
+    case OV7670_REG_AECHH:
+    case OV7670_REG_AECH:
+    case OV7670_REG_GGAIN:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void sccb_shadow::set_known(uint8_t reg, bool known)
+{
+    if (known)
+        known_[reg / 32] |= 1u << (reg % 32);
+    else
+        known_[reg / 32] &= ~(1u << (reg % 32));
+}
@@ -0,0 +1,89 @@
+#ifndef SCCB_SHADOW_H_
+#define SCCB_SHADOW_H_
+
+#include <pico/stdlib.h>
+#include <hardware/i2c.h>
+#include "reg_config.h"
+
+/*
+driver side shadow of the ov7670 register file
+every register written through the shadow is remembered, writing the same value again costs no SCCB transaction,
+so switching resolution or color format only sends the registers which really change, without sensor reset.
+
+registers driven by AGC/AEC/AWB change by themselves, they are never skipped.
+COM7 reset forgets everything, the sensor is back to its unknown power on values.
+*/
+
+bool i2c_write_register(i2c_inst_t* i2c, uint8_t addr, uint8_t reg, uint8_t val);  // addr is device address
+uint8_t i2c_read_register(i2c_inst_t* i2c, uint8_t addr, uint8_t reg);             // addr is device address
+
+struct sccb_stats
+{
+    uint32_t writes = 0;        // SCCB write transactions
+    uint32_t reads = 0;         // SCCB read transactions
+    uint32_t skipped = 0;       // writes saved by the shadow
+    uint32_t errors = 0;        // NAK or read back mismatch
+};
+
+
+class sccb_shadow
+{
+public:
+    sccb_shadow(i2c_inst_t* i2c, uint8_t addr);
+    ~sccb_shadow();
+
+public:
+    /*
+    write one register if the shadow doesn't already hold the value
+    @return false if the sensor doesn't acknowledge, or read back doesn't match
+    */
+    bool write(uint8_t reg, uint8_t value);
+    uint8_t read(uint8_t reg);      // always from the sensor, the shadow is refreshed
+
+    // write a register table in order, same register may appear more than once
+    void apply(const i2c_command* cmds, size_t len);
+    template <size_t N>
+    void apply(const i2c_command (&cmds)[N]) { apply(cmds, N); }
+    template <size_t N>
+    void apply(const reg_sequence<N>& seq) { apply(seq.cmds, N); }
+
+    /*
+    queue a table to be written by commit(), a register queued again moves to its last position and takes the last value,
+    the same rule as merge_reg_sequences(), so a mode made of several tables sends every register once
+    */
+    void stage(const i2c_command* cmds, size_t len);
+    template <size_t N>
+    void stage(const i2c_command (&cmds)[N]) { stage(cmds, N); }
+    template <size_t N>
+    void stage(const reg_sequence<N>& seq) { stage(seq.cmds, N); }
+    uint32_t commit();      // write the queued registers which differ from the shadow, @return SCCB writes
+
+    void set_verify(bool verify) { verify_ = verify; }   // read back every real write
+    uint32_t verify_all();                               // read back every known register, @return mismatches
+    void invalidate();                                   // forget all values
+
+    const sccb_stats& get_stats() const { return stats_; }
+    uint32_t get_transactions() const { return stats_.writes + stats_.reads; }
+
+private:
+    static bool is_volatile(uint8_t reg);
+    bool is_known(uint8_t reg) const { return known_[reg / 32] & (1u << (reg % 32)); }
+    void set_known(uint8_t reg, bool known);
+
+private:
+    i2c_inst_t* i2c_;
+    uint8_t addr_;
+    bool verify_ = false;
+    uint8_t value_[256];
+    uint32_t known_[8];
+    sccb_stats stats_;
+
+    // staged registers, in the order they are last queued
+    uint8_t staged_value_[256];
+    uint8_t staged_order_[256];
+    uint32_t staged_[8];
+    size_t staged_count_ = 0;
+};
+
+
+#endif
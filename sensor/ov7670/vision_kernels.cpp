@@ -0,0 +1,260 @@
+#include "vision_kernels.h"
+
+// round(sum / 9) for sum <= 9 * 255, checked against the division by the host bench
+static inline uint32_t div9(uint32_t sum)
+{
+    return (sum * 7282 + 32768) >> 16;
+}
+
+void box_blur_row(const uint8_t* above, const uint8_t* row, const uint8_t* below, uint8_t* out, size_t width)
+{
+    // column sums slide along the row, 3 loads per pixel
+    uint32_t left = above[0] + row[0] + below[0];
+    uint32_t mid = left;
+    for (size_t x = 0; x < width; x++)
+    {
+        size_t n = x + 1 < width ? x + 1 : x;
+        uint32_t right = above[n] + row[n] + below[n];
+        out[x] = div9(left + mid + right);
+        left = mid;
+        mid = right;
+    }
+}
+
+void gaussian_blur_row(const uint8_t* above, const uint8_t* row, const uint8_t* below, uint8_t* out, size_t width)
+{
+    uint32_t left = above[0] + 2 * row[0] + below[0];
+    uint32_t mid = left;
+    for (size_t x = 0; x < width; x++)
+    {
+        size_t n = x + 1 < width ? x + 1 : x;
+        uint32_t right = above[n] + 2 * row[n] + below[n];
+        out[x] = (left + 2 * mid + right + 8) >> 4;
+        left = mid;
+        mid = right;
+    }
+}
+
+void sobel_row(const uint8_t* above, const uint8_t* row, const uint8_t* below, uint8_t* out, size_t width)
+{
+    // gx from the vertically smoothed columns s, gy from the smoothed column differences d
+    int32_t s_left = above[0] + 2 * row[0] + below[0];
+    int32_t s_mid = s_left;
+    int32_t d_left = below[0] - above[0];
+    int32_t d_mid = d_left;
+    for (size_t x = 0; x < width; x++)
+    {
+        size_t n = x + 1 < width ? x + 1 : x;
+        int32_t s_right = above[n] + 2 * row[n] + below[n];
+        int32_t d_right = below[n] - above[n];
+        int32_t gx = s_right - s_left;
+        int32_t gy = d_left + 2 * d_mid + d_right;
+        uint32_t g = uint32_t((gx < 0 ? -gx : gx) + (gy < 0 ? -gy : gy)) >> 2;
+        out[x] = g > 255 ? 255 : g;
+        s_left = s_mid;
+        s_mid = s_right;
+        d_left = d_mid;
+        d_mid = d_right;
+    }
+}
+
+void apply_row_kernel(row_kernel_t kernel, const uint8_t* src, uint8_t* dst, size_t width, size_t height)
+{
+    for (size_t y = 0; y < height; y++)
+    {
+        const uint8_t* above = src + (y ? y - 1 : 0) * width;
+        const uint8_t* below = src + (y + 1 < height ? y + 1 : y) * width;
+        kernel(above, src + y * width, below, dst + y * width, width);
+    }
+}
+
+void threshold_row(const uint8_t* src, uint8_t* out, size_t width, uint8_t level)
+{
+    for (size_t x = 0; x < width; x++)
+    {
+        out[x] = src[x] > level ? 255 : 0;
+    }
+}
+
+uint8_t otsu_level(const luma_stats& stats)
+{
+    // between class variance w0 * w1 * (m0 - m1)^2, means in 8.8 fixed point, weights scaled by 1 / count
+    uint64_t total = stats.count;
+    uint64_t w0 = 0;
+    uint64_t sum0 = 0;
+    uint64_t best = 0;
+    uint8_t level = stats.mean();
+    for (uint32_t t = 0; t < 255; t++)
+    {
+        w0 += stats.bins[t];
+        sum0 += uint64_t(t) * stats.bins[t];
+        uint64_t w1 = total - w0;
+        if (!w0 || !w1)
+        {
+            continue;
+        }
+        uint64_t m0 = (sum0 << 8) / w0;
+        uint64_t m1 = ((stats.sum - sum0) << 8) / w1;
+        uint64_t between = w0 * w1 / total * (m1 - m0) * (m1 - m0);
+        if (between > best)
+        {
+            best = between;
+            level = t;
+        }
+    }
+    return level;
+}
+
+
+void blob_finder::begin()
+{
+    run_count_[0] = run_count_[1] = 0;
+    cur_ = 0;
+    labels_ = 0;
+    dropped_runs_ = 0;
+}
+
+void blob_finder::add_row(const uint8_t* mask, size_t width, uint16_t y)
+{
+    const uint16_t NO_LABEL = 0xffff;
+    const run* above = runs_[cur_];
+    uint16_t above_count = run_count_[cur_];
+    cur_ ^= 1;
+    run* runs = runs_[cur_];
+    uint16_t count = 0;
+
+    size_t j = 0;
+    size_t x = 0;
+    while (x < width)
+    {
+        if (!mask[x])
+        {
+            ++x;
+            continue;
+        }
+        uint16_t x0 = x;
+        while (x < width && mask[x])
+        {
+            ++x;
+        }
+        uint16_t x1 = x - 1;
+
+        // runs above ending left of this one can not touch the next ones either
+        while (j < above_count && above[j].x1 + 1 < x0)
+        {
+            ++j;
+        }
+        uint16_t label = NO_LABEL;
+        for (size_t k = j; k < above_count && above[k].x0 <= x1 + 1; k++)
+        {
+            label = label == NO_LABEL ? find(above[k].label) : merge(label, above[k].label);
+        }
+
+        if (count == BLOB_MAX_RUNS || (label == NO_LABEL && labels_ == BLOB_MAX_LABELS))
+        {
+            ++dropped_runs_;
+            continue;
+        }
+        if (label == NO_LABEL)
+        {
+            label = labels_++;
+            parent_[label] = label;
+            blobs_[label] = {0, 0, 0, x0, y, x1, y};
+        }
+
+        // label is a root, the run goes into its statistics
+        blob& b = blobs_[label];
+        uint32_t len = x1 - x0 + 1;
+        b.area += len;
+        b.sum_x += (uint32_t(x0) + x1) * len / 2;
+        b.sum_y += uint32_t(y) * len;
+        b.x0 = x0 < b.x0 ? x0 : b.x0;
+        b.x1 = x1 > b.x1 ? x1 : b.x1;
+        b.y1 = y;
+        runs[count++] = {x0, x1, label};
+    }
+    run_count_[cur_] = count;
+}
+
+size_t blob_finder::finish(blob* blobs, size_t max, uint32_t min_area)
+{
+    size_t count = 0;
+    for (uint16_t l = 0; l < labels_; l++)
+    {
+        const blob& b = blobs_[l];
+        if (parent_[l] != l || b.area < min_area)
+        {
+            continue;
+        }
+
+        // insertion, largest first, the smallest falls out when full
+        size_t i = count < max ? count++ : max;
+        for (; i > 0 && blobs[i - 1].area < b.area; i--)
+        {
+            if (i < max)
+            {
+                blobs[i] = blobs[i - 1];
+            }
+        }
+        if (i < max)
+        {
+            blobs[i] = b;
+        }
+    }
+    return count;
+}
+
+uint16_t blob_finder::find(uint16_t label)
+{
+    // path halving
+    while (parent_[label] != label)
+    {
+        parent_[label] = parent_[parent_[label]];
+        label = parent_[label];
+    }
+    return label;
+}
+
+uint16_t blob_finder::merge(uint16_t a, uint16_t b)
+{
+    a = find(a);
+    b = find(b);
+    if (a == b)
+    {
+        return a;
+    }
+    if (b < a)
+    {
+        uint16_t t = a;
+        a = b;
+        b = t;
+    }
+
+    parent_[b] = a;
+    blob& to = blobs_[a];
+    const blob& from = blobs_[b];
+    to.area += from.area;
+    to.sum_x += from.sum_x;
+    to.sum_y += from.sum_y;
+    to.x0 = from.x0 < to.x0 ? from.x0 : to.x0;
+    to.y0 = from.y0 < to.y0 ? from.y0 : to.y0;
+    to.x1 = from.x1 > to.x1 ? from.x1 : to.x1;
+    to.y1 = from.y1 > to.y1 ? from.y1 : to.y1;
+    return a;
+}
+
+
+size_t find_blobs(const uint8_t* luma, size_t width, size_t height, uint8_t level, uint8_t* scratch,
+                  blob_finder& finder, blob* blobs, size_t max, uint32_t min_area)
+{
+    finder.begin();
+    for (size_t y = 0; y < height; y++)
+    {
+        const uint8_t* above = luma + (y ? y - 1 : 0) * width;
+        const uint8_t* below = luma + (y + 1 < height ? y + 1 : y) * width;
+        gaussian_blur_row(above, luma + y * width, below, scratch, width);
+        threshold_row(scratch, scratch, width, level);
+        finder.add_row(scratch, width, y);
+    }
+    return finder.finish(blobs, max, min_area);
+}
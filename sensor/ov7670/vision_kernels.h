@@ -0,0 +1,107 @@
+#ifndef VISION_KERNELS_H_
+#define VISION_KERNELS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "luma_stats.h"
+
+/*
+integer image processing on the luma plane, no float and no division in the per pixel code (cortex-m0+ has neither)
+no SDK dependency, the PC side tools (host/) build vision_kernels.cpp too
+
+3x3 kernels make one output row from three input rows, a frame is processed in bands of 3 rows:
+the caller keeps three rows, not a second frame. the first and last rows and columns repeat the edge pixel.
+
+blob labelling streams too: every row is cut into runs of foreground pixels, runs touching a run of the row above
+(8-connected) join its blob through union find, only the runs of the previous row are kept.
+*/
+
+// one output row from the rows above, at and below it
+typedef void (*row_kernel_t)(const uint8_t* above, const uint8_t* row, const uint8_t* below, uint8_t* out, size_t width);
+
+void box_blur_row(const uint8_t* above, const uint8_t* row, const uint8_t* below, uint8_t* out, size_t width);        // 3x3 mean, rounded
+void gaussian_blur_row(const uint8_t* above, const uint8_t* row, const uint8_t* below, uint8_t* out, size_t width);   // 1 2 1 / 2 4 2 / 1 2 1, rounded
+void sobel_row(const uint8_t* above, const uint8_t* row, const uint8_t* below, uint8_t* out, size_t width);           // (|gx| + |gy|) / 4, saturated
+
+/*
+whole plane through a row kernel, a band at a time
+@param dst width * height, not src
+*/
+void apply_row_kernel(row_kernel_t kernel, const uint8_t* src, uint8_t* dst, size_t width, size_t height);
+
+// 255 above level, 0 at or below
+void threshold_row(const uint8_t* src, uint8_t* out, size_t width, uint8_t level);
+
+// Otsu's level from the histogram the capture has built, the pixels above it are foreground
+uint8_t otsu_level(const luma_stats& stats);
+
+
+struct blob
+{
+    uint32_t area;          // pixels
+    uint32_t sum_x;         // sum of the x of every pixel, centroid = sum / area
+    uint32_t sum_y;
+    uint16_t x0, y0;        // bounding box, inclusive
+    uint16_t x1, y1;
+
+    uint32_t centroid_x16() const { return area ? (sum_x * 16 + area / 2) / area : 0; }     // 1/16 pixel
+    uint32_t centroid_y16() const { return area ? (sum_y * 16 + area / 2) / area : 0; }
+};
+
+const uint32_t BLOB_MAX_RUNS = 128;     // runs per row, 640 pixels make 320 at worst, the rest are dropped
+const uint32_t BLOB_MAX_LABELS = 128;   // blobs alive in a frame, merged ones are not reused
+
+
+/*
+streaming connected component labelling
+    begin()
+    add_row(mask, y) for every row, top to bottom, nonzero is foreground
+    finish(blobs, max)
+runs without a free label or a free run slot are dropped and counted, the blobs they belong to come out smaller
+*/
+class blob_finder
+{
+public:
+    void begin();
+    void add_row(const uint8_t* mask, size_t width, uint16_t y);
+
+    /*
+    @param min_area smaller blobs are noise
+    @return blobs written, largest first
+    */
+    size_t finish(blob* blobs, size_t max, uint32_t min_area = 1);
+
+    uint32_t get_dropped_runs() const { return dropped_runs_; }
+
+private:
+    struct run
+    {
+        uint16_t x0, x1;    // inclusive
+        uint16_t label;
+    };
+
+    uint16_t find(uint16_t label);
+    uint16_t merge(uint16_t a, uint16_t b);     // the root of both
+
+private:
+    run runs_[2][BLOB_MAX_RUNS];
+    uint16_t run_count_[2] = {0, 0};
+    uint32_t cur_ = 0;
+
+    uint16_t parent_[BLOB_MAX_LABELS];
+    blob blobs_[BLOB_MAX_LABELS];
+    uint16_t labels_ = 0;
+    uint32_t dropped_runs_ = 0;
+};
+
+
+/*
+bright blobs of a luma plane in one streaming pass: gaussian blur, threshold, labelling
+@param scratch width bytes, one blurred row
+@return blobs written, largest first
+*/
+size_t find_blobs(const uint8_t* luma, size_t width, size_t height, uint8_t level, uint8_t* scratch,
+                  blob_finder& finder, blob* blobs, size_t max, uint32_t min_area = 1);
+
+
+#endif